@@ -3,7 +3,11 @@ set_property(GLOBAL PROPERTY USE_FOLDERS ON)
 cmake_policy(SET CMP0155 OLD)
 
 option(BUILD_MAA_UTILS "build maa utils" ON)
+option(BUILD_MAA_LOG_DECODER "build the offline decoder of binary logs" OFF)
+option(BUILD_MAA_TIME_BENCH "build the microbenchmark of log timestamp formatting" OFF)
 option(WITH_RPATH_LIBRARY "with rpath library for linux" ${LINUX})
+option(WITH_ZLIB "gzip rotated logs and read them in the log decoder, if zlib is found" ON)
+set(MAA_LOG_MIN_LEVEL "" CACHE STRING "log statements above this level (0-7) are compiled out, empty for 7 in Debug and 4 otherwise")
 
 set(Boost_NO_WARN_NEW_VERSIONS ON)
 
@@ -19,12 +23,19 @@ include(${MAAUTILS_DIR}/cmake/config.cmake)
 include(${MAAUTILS_DIR}/cmake/utils.cmake)
 include(${MAAUTILS_DIR}/cmake/version.cmake)
 
+if(NOT MAA_LOG_MIN_LEVEL STREQUAL "")
+    add_compile_definitions("MAA_LOG_MIN_LEVEL=${MAA_LOG_MIN_LEVEL}")
+endif()
+
 find_package(OpenCV REQUIRED COMPONENTS core imgproc imgcodecs)
 find_package(Boost REQUIRED CONFIG COMPONENTS system)
-find_package(ZLIB REQUIRED)
 find_package(fastdeploy_ppocr REQUIRED)
 find_package(ONNXRuntime REQUIRED)
 
+if(WITH_ZLIB)
+    find_package(ZLIB)
+endif()
+
 find_program(CCACHE_PROG ccache)
 
 if(CCACHE_PROG)
@@ -40,4 +51,12 @@ include_directories(${MAAUTILS_DIR}/include)
 
 if(BUILD_MAA_UTILS)
     add_subdirectory(${MAAUTILS_DIR}/source ${CMAKE_CURRENT_BINARY_DIR}/MaaUtils)
+endif()
+
+if(BUILD_MAA_LOG_DECODER)
+    add_subdirectory(${MAAUTILS_DIR}/tools/LogDecoder ${CMAKE_CURRENT_BINARY_DIR}/MaaLogDecoder)
+endif()
+
+if(BUILD_MAA_TIME_BENCH)
+    add_subdirectory(${MAAUTILS_DIR}/tools/TimeBench ${CMAKE_CURRENT_BINARY_DIR}/MaaTimeBench)
 endif()
\ No newline at end of file
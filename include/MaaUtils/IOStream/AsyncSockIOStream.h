@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "BoostIO.hpp"
+#include "MaaUtils/NonCopyable.hpp"
+#include "MaaUtils/Port.h"
+
+MAA_NS_BEGIN
+
+class MAA_UTILS_API AsyncSockIOStream;
+
+// The async factories and streams run on a caller-owned io_context,
+// so one thread calling io_context::run() can drive any number of connections.
+class MAA_UTILS_API AsyncServerSockIOFactory : public NonCopyButMovable
+{
+public:
+    AsyncServerSockIOFactory(boost::asio::io_context& io_ctx, const std::string& address, uint16_t port);
+    ~AsyncServerSockIOFactory();
+
+    uint16_t port() const;
+
+public:
+    // nullptr on failure or after the factory is destroyed
+    boost::asio::awaitable<std::shared_ptr<AsyncSockIOStream>> accept();
+
+private:
+    boost::asio::ip::tcp::acceptor server_acceptor_;
+};
+
+class MAA_UTILS_API AsyncClientSockIOFactory : public NonCopyButMovable
+{
+public:
+    AsyncClientSockIOFactory(boost::asio::io_context& io_ctx, const std::string& address, unsigned short port);
+    ~AsyncClientSockIOFactory() = default;
+
+public:
+    boost::asio::awaitable<std::shared_ptr<AsyncSockIOStream>> connect();
+
+private:
+    boost::asio::io_context::executor_type executor_;
+    boost::asio::ip::tcp::endpoint endpoint_;
+};
+
+// Coroutine counterpart of SockIOStream, the reads and writes return the same results as there.
+// Arguments are views, they must outlive the co_await. At most one read and one write may be pending,
+// a read timeout cancels only the read.
+class MAA_UTILS_API AsyncSockIOStream : public NonCopyable
+{
+public:
+    using duration_t = std::chrono::milliseconds;
+
+    template <typename T>
+    using awaitable = boost::asio::awaitable<T>;
+
+public:
+    explicit AsyncSockIOStream(boost::asio::ip::tcp::socket&& socket);
+    ~AsyncSockIOStream();
+
+public:
+    awaitable<std::string> read_some(size_t count, duration_t timeout = duration_t::max());
+    awaitable<std::string> read_until(std::string_view delimiter, duration_t timeout = duration_t::max());
+    // false if the stream ends or `timeout` passes before `buffer` is full, nothing is consumed then
+    awaitable<bool> read_exact(std::span<char> buffer, duration_t timeout = duration_t::max());
+
+    // `data` and a newline
+    awaitable<bool> write(std::string_view data);
+    // all messages in one gathered write
+    awaitable<bool> write_batch(std::span<const std::string_view> messages, bool newline = true);
+
+    bool release();
+    bool is_open() const;
+
+private:
+    std::string take_read_buffer(size_t count);
+    void on_read_error(const boost::system::error_code& ec);
+
+private:
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::steady_timer read_deadline_;
+    uint64_t deadline_generation_ = 0;
+    bool eof_ = false;
+
+    // read past the delimiter by read_until(), served first by every read
+    std::string read_buffer_;
+};
+
+MAA_NS_END
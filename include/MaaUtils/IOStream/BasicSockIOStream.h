@@ -0,0 +1,126 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+
+#include "IOStream.h"
+#include "MaaUtils/NonCopyable.hpp"
+#include "MaaUtils/Port.h"
+
+MAA_NS_BEGIN
+
+// Blocking socket stream over an Asio stream protocol, the common part of SockIOStream (TCP) and LocalSockIOStream (AF_UNIX).
+// Defined in BasicSockIOStream.cpp and only instantiated there for those two, use them instead.
+template <typename Protocol>
+class BasicSockIOStream : public IOStream
+{
+public:
+    using protocol_type = Protocol;
+    using iostream_type = typename Protocol::iostream;
+
+public:
+    explicit BasicSockIOStream(iostream_type&& ios);
+
+    // NonCopyButMovable
+    // https://stackoverflow.com/questions/29289956/c11-virtual-destructors-and-auto-generation-of-move-special-functions
+    BasicSockIOStream(const BasicSockIOStream&) = delete;
+    BasicSockIOStream(BasicSockIOStream&&) = default;
+    BasicSockIOStream& operator=(const BasicSockIOStream&) = delete;
+    BasicSockIOStream& operator=(BasicSockIOStream&&) = default;
+
+    virtual ~BasicSockIOStream() override;
+
+public:
+    virtual bool write_buffered(std::string_view data, bool newline = true) override;
+    virtual bool write_batch(std::span<const std::string_view> messages, bool newline = true) override;
+    virtual bool flush() override;
+
+    virtual bool release() override;
+    virtual bool is_open() const override;
+    virtual void shutdown_read() override;
+
+    void expires_after(duration_t timeout);
+
+    // For connections kept idle: false once the peer closed or reset it, or if unread bytes are waiting. Does not block.
+    bool probe_idle();
+
+protected:
+    virtual std::string read_once(size_t max_count) override;
+    virtual size_t read_once_into(std::span<char> buffer) override;
+    virtual size_t read_available(char* buffer, size_t max_count) override;
+    virtual bool wait_readable(duration_t timeout) override;
+
+    // called after every read that reached the socket
+    virtual void after_read() {}
+
+    decltype(auto) socket() { return ios_.socket(); }
+
+private:
+    iostream_type ios_;
+
+    std::unique_ptr<char[]> buffer_ = nullptr;
+};
+
+// `Stream` is the BasicSockIOStream subclass handed out, constructed from an iostream and its `options_type`.
+template <typename Stream>
+class BasicServerSockIOFactory : public NonCopyButMovable
+{
+public:
+    using duration_t = IOStream::duration_t;
+    using protocol_type = typename Stream::protocol_type;
+    using options_type = typename Stream::options_type;
+
+    static constexpr duration_t kDefaultAcceptTimeout = std::chrono::seconds(2);
+
+public:
+    ~BasicServerSockIOFactory();
+
+    // Every accept() also takes up to `count` further connections that are already waiting, without blocking,
+    // and hands them out first on the next calls. 0 (the default) keeps one connection per call.
+    void set_preaccept_backlog(size_t count);
+
+public:
+    // nullptr on timeout
+    std::shared_ptr<Stream> accept(duration_t timeout = kDefaultAcceptTimeout);
+
+protected:
+    // subclasses open, bind and listen on `server_acceptor_`
+    explicit BasicServerSockIOFactory(const options_type& options);
+
+private:
+    void preaccept();
+
+protected:
+    options_type options_;
+
+    boost::asio::io_context io_ctx_;
+    typename protocol_type::acceptor server_acceptor_;
+
+private:
+    size_t preaccept_backlog_ = 0;
+    std::deque<std::shared_ptr<Stream>> preaccepted_;
+};
+
+template <typename Stream>
+class BasicClientSockIOFactory : public NonCopyButMovable
+{
+public:
+    using protocol_type = typename Stream::protocol_type;
+    using options_type = typename Stream::options_type;
+
+public:
+    ~BasicClientSockIOFactory() = default;
+
+public:
+    // nullptr on failure or after options.connect_timeout
+    std::shared_ptr<Stream> connect();
+
+protected:
+    BasicClientSockIOFactory(const typename protocol_type::endpoint& endpoint, const options_type& options);
+
+private:
+    options_type options_;
+    typename protocol_type::endpoint endpoint_;
+};
+
+MAA_NS_END
@@ -1,53 +1,121 @@
 #pragma once
 
+#include <chrono>
+#include <future>
 #include <memory>
+#include <vector>
 
 #include "IOStream.h"
 #include "MaaUtils/Port.h"
 
 MAA_NS_BEGIN
 
+struct ChildPipeOptions
+{
+    // F_SETPIPE_SZ of the stdin / stdout pipes, 0 keeps the system default. Linux only.
+    size_t pipe_size = 0;
+    // Keeps the child's stderr for read_stderr() instead of discarding it. Linux only.
+    // The child blocks once that pipe is full, so drain it regularly.
+    bool capture_stderr = false;
+    // Become fds 3, 4, ... of the child in this order, whatever their numbers here. Linux only.
+    // The parent's copies should be close-on-exec, so that no other child inherits them.
+    std::vector<int> extra_fds;
+
+    // How long release() waits for the child to exit on its own (stdin is closed first), then SIGKILL.
+    // Buffered input gets as long to be written before stdin is closed, what the child does not take by then is dropped.
+    std::chrono::milliseconds graceful_period = std::chrono::milliseconds(100);
+    // Sends SIGTERM and waits another graceful_period before SIGKILL. Not on Windows.
+    bool terminate_first = false;
+};
+
+// On Linux the child is started with posix_spawn (vfork semantics, cheap for a large parent) over raw
+// non-blocking pipes; elsewhere with boost::process.
 class MAA_UTILS_API ChildPipeIOStream : public IOStream
 {
 public:
-    ChildPipeIOStream(const std::filesystem::path& exec, const std::vector<std::string>& args);
+    ChildPipeIOStream(const std::filesystem::path& exec, const std::vector<std::string>& args, const ChildPipeOptions& options = {});
 
 #ifdef _WIN32
-    ChildPipeIOStream(const std::filesystem::path& exec, const std::vector<std::wstring>& wargs);
+    ChildPipeIOStream(const std::filesystem::path& exec, const std::vector<std::wstring>& wargs, const ChildPipeOptions& options = {});
 #endif
 
     // NonCopyButMovable
     // https://stackoverflow.com/questions/29289956/c11-virtual-destructors-and-auto-generation-of-move-special-functions
     ChildPipeIOStream(const ChildPipeIOStream&) = delete;
-    ChildPipeIOStream(ChildPipeIOStream&&) = default;
     ChildPipeIOStream& operator=(const ChildPipeIOStream&) = delete;
+#ifdef __linux__
+    ChildPipeIOStream(ChildPipeIOStream&& other) noexcept;
+    ChildPipeIOStream& operator=(ChildPipeIOStream&& other) noexcept;
+#else
+    ChildPipeIOStream(ChildPipeIOStream&&) = default;
     ChildPipeIOStream& operator=(ChildPipeIOStream&&) = default;
+#endif
 
     virtual ~ChildPipeIOStream() override;
 
 public:
-    virtual bool write(std::string_view data) override;
+    virtual bool write_buffered(std::string_view data, bool newline = true) override;
+    virtual bool write_batch(std::span<const std::string_view> messages, bool newline = true) override;
+    virtual bool flush() override;
 
     virtual bool release() override;
     virtual bool is_open() const override;
 
+    // release() on another thread, the stream must outlive the future
+    std::future<bool> release_async();
+    // whether the process is still alive, without touching the pipes
+    bool running();
+#ifdef __linux__
+    // -1 if the spawn failed or once the child is reaped
+    pid_t pid() const { return pid_; }
+#endif
+
+    // what the child wrote to stderr so far, without blocking, empty unless captured
+    std::string read_stderr();
+    // whether stdout has bytes nobody read yet, without blocking. Not checked on the pipe itself on Windows.
+    bool has_pending_output();
+
 protected:
     virtual std::string read_once(size_t max_count) override;
+    virtual size_t read_once_into(std::span<char> buffer) override;
+    virtual size_t read_available(char* buffer, size_t max_count) override;
+    virtual bool wait_readable(duration_t timeout) override;
 
 private:
     using os_string = std::filesystem::path::string_type;
 
-    ChildPipeIOStream(const std::filesystem::path& exec, const std::vector<os_string>& args, bool);
+    ChildPipeIOStream(const std::filesystem::path& exec, const std::vector<os_string>& args, const ChildPipeOptions& options, bool);
+
+#ifdef __linux__
+    void spawn();
+    void close_fds();
+    bool wait_exit(duration_t timeout);
+    // writes out write_buffer_, which is empty afterwards even if it failed
+    bool flush_for(duration_t timeout);
+#endif
 
 private:
     std::filesystem::path exec_;
     std::vector<os_string> args_;
-
+    ChildPipeOptions options_;
+
+#ifdef __linux__
+    pid_t pid_ = -1;
+    // parent ends: the child's stdout, stdin and stderr
+    int in_fd_ = -1;
+    int out_fd_ = -1;
+    int err_fd_ = -1;
+    bool eof_ = false;
+    int exit_code_ = -1;
+
+    std::string write_buffer_;
+#else
     boost::process::ipstream pin_;
     boost::process::opstream pout_;
     boost::process::child child_;
 
     std::unique_ptr<char[]> buffer_ = nullptr;
+#endif
 };
 
 MAA_NS_END
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ChildPipeIOStream.h"
+#include "MaaUtils/NonCopyable.hpp"
+#include "MaaUtils/Port.h"
+
+MAA_NS_BEGIN
+
+// Keeps `warm_count` started children per prewarm()ed (exec, args), so acquire() is a queue pop instead of a process start.
+// A background thread refills the pool, replaces children that died while idle and checks returned ones.
+class MAA_UTILS_API ChildProcessPool : public NonCopyable
+{
+public:
+    // Run on a returned child before it is handed out again, false drops it.
+    // A child with unread output is dropped without it, the next lessee would read that output.
+    using HealthCheck = std::function<bool(ChildPipeIOStream&)>;
+
+public:
+    explicit ChildProcessPool(size_t warm_count, ChildPipeOptions options = {}, HealthCheck health_check = nullptr);
+    ~ChildProcessPool();
+
+public:
+    // Pools this key from now on and starts its warm children. Keys are never forgotten, so prewarm a fixed set.
+    void prewarm(const std::filesystem::path& exec, const std::vector<std::string>& args);
+
+    // A warm child if there is one, otherwise a new one. Dropping the last copy of the lease returns the child
+    // if the key is pooled; release() it instead to retire it. nullptr if the process cannot be started.
+    std::shared_ptr<ChildPipeIOStream> acquire(const std::filesystem::path& exec, const std::vector<std::string>& args);
+
+    size_t idle_count(const std::filesystem::path& exec, const std::vector<std::string>& args) const;
+
+private:
+    struct State;
+
+    void working();
+
+private:
+    std::shared_ptr<State> state_;
+    std::thread worker_;
+};
+
+MAA_NS_END
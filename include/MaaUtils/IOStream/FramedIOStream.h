@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "IOStream.h"
+#include "MaaUtils/NonCopyable.hpp"
+#include "MaaUtils/Port.h"
+
+MAA_NS_BEGIN
+
+// Length-prefixed frames over any IOStream, so payloads may hold arbitrary bytes.
+//
+// frame := size:u32 [type:u8 if typed] payload[size]      // little endian
+//
+// A frame is read with one header read and one bulk read into a buffer reused across frames.
+// Both ends must agree on `typed`.
+class MAA_UTILS_API FramedIOStream : public NonCopyButMovable
+{
+public:
+    using duration_t = IOStream::duration_t;
+
+    static constexpr size_t kDefaultMaxFrameSize = 256 * 1024 * 1024;
+
+    struct Frame
+    {
+        uint8_t type = 0;
+        // valid until the next read_frame()
+        std::string_view payload;
+    };
+
+public:
+    explicit FramedIOStream(std::shared_ptr<IOStream> stream, bool typed = false, size_t max_frame_size = kDefaultMaxFrameSize);
+
+public:
+    bool write_frame(std::string_view payload, uint8_t type = 0);
+    // all frames in one write_batch()
+    bool write_frames(std::span<const std::string_view> payloads, uint8_t type = 0);
+    // one frame whose payload is `parts` concatenated, without copying them together
+    bool write_frame_parts(std::span<const std::string_view> parts, uint8_t type = 0);
+
+    // nullopt if the stream ends, `timeout` passes or the frame exceeds the limit.
+    // After a timeout the next call resumes the same frame.
+    std::optional<Frame> read_frame(duration_t timeout = duration_t::max());
+
+    bool is_open() const { return stream_->is_open(); }
+
+    const std::shared_ptr<IOStream>& stream() const { return stream_; }
+
+private:
+    static constexpr size_t kMaxHeaderSize = sizeof(uint32_t) + 1;
+    using Header = std::array<char, kMaxHeaderSize>;
+
+    size_t header_size() const { return typed_ ? kMaxHeaderSize : sizeof(uint32_t); }
+
+    void make_header(Header& header, size_t size, uint8_t type) const;
+
+private:
+    std::shared_ptr<IOStream> stream_;
+    bool typed_ = false;
+    size_t max_frame_size_ = kDefaultMaxFrameSize;
+
+    struct PendingHeader
+    {
+        uint32_t size = 0;
+        uint8_t type = 0;
+    };
+
+    // a header whose payload did not arrive before the last timeout
+    std::optional<PendingHeader> pending_;
+    std::string buffer_;
+};
+
+MAA_NS_END
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <chrono>
+#include <limits>
+#include <span>
 #include <string>
 #include <string_view>
 
@@ -18,17 +20,63 @@ public:
     virtual ~IOStream() = default;
 
 public:
-    virtual bool write(std::string_view data) = 0;
+    // `data` and a newline, flushed right away: write_buffered() then flush()
+    virtual bool write(std::string_view data);
+    // Stays in the stream buffer until flush(), the next write() or a full buffer, so commands can be pipelined.
+    // The write primitive of every stream, unbuffered streams write right away and keep the default flush().
+    virtual bool write_buffered(std::string_view data, bool newline = true) = 0;
+    // Everything buffered, then `messages` in as few syscalls as possible. Nothing is left buffered.
+    virtual bool write_batch(std::span<const std::string_view> messages, bool newline = true);
+    virtual bool flush() { return true; }
 
     virtual std::string read(duration_t timeout = duration_t::max());
     virtual std::string read_some(size_t count, duration_t timeout = duration_t::max());
     virtual std::string read_until(std::string_view delimiter, duration_t timeout = duration_t::max());
 
+    // Reads into the caller's memory without an intermediate string.
+    // read_into blocks for at least one byte and returns the count, 0 once the stream ends.
+    size_t read_into(std::span<char> buffer);
+    // false if the stream ends or `timeout` passes before `buffer` is full, nothing is consumed then
+    bool read_exact(std::span<char> buffer, duration_t timeout = duration_t::max());
+    // Up to `max_count` bytes inside the stream's own buffer, valid until the next read of any kind.
+    std::string_view read_view(size_t max_count = std::numeric_limits<size_t>::max());
+    // False if nothing becomes readable within `timeout`, true once the stream ended. Consumes nothing.
+    bool wait_for_input(duration_t timeout);
+
     virtual bool release() = 0;
     virtual bool is_open() const = 0;
+    // Makes a read blocked on another thread return as if the stream ended, safe to call while it blocks.
+    // The default does nothing, such a read returns once data arrives or the peer closes.
+    virtual void shutdown_read() {}
 
 protected:
+    // blocks until exactly `max_count` bytes are read or the stream ends
     virtual std::string read_once(size_t max_count) = 0;
+    // read_once into `buffer`, the default copies from read_once
+    virtual size_t read_once_into(std::span<char> buffer);
+    // Blocks for at least one byte, then returns whatever else is readable without blocking, up to `max_count`.
+    // The default reads a single byte.
+    virtual size_t read_available(char* buffer, size_t max_count);
+    // False if nothing becomes readable within `timeout`, reads with a finite timeout then go through
+    // read_available(), so they return partial data instead of blocking. The default never waits.
+    virtual bool wait_readable(duration_t timeout);
+
+    // whether read_until() read ahead bytes that the next read returns first
+    bool has_buffered_input() const { return read_pos_ < read_buffer_.size(); }
+
+private:
+    static duration_t remaining_time(const std::chrono::steady_clock::time_point& start_time, duration_t timeout);
+    size_t read_before(std::span<char> buffer, const std::chrono::steady_clock::time_point& start_time, duration_t timeout);
+    size_t fill_read_buffer();
+    std::string take_read_buffer(size_t count);
+    size_t take_read_buffer(std::span<char> buffer);
+    void consume_read_buffer(size_t count);
+
+private:
+    // bytes read ahead by read_until() past its delimiter, served first by every read
+    std::string read_buffer_;
+    // start of the unread bytes, everything before it was consumed, possibly through read_view()
+    size_t read_pos_ = 0;
 };
 
 MAA_NS_END
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "BasicSockIOStream.h"
+#include "MaaUtils/Port.h"
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+MAA_NS_BEGIN
+
+struct LocalSockOptions
+{
+    // client only
+    IOStream::duration_t connect_timeout = IOStream::duration_t::max();
+};
+
+extern template class MAA_UTILS_API BasicSockIOStream<boost::asio::local::stream_protocol>;
+
+// Same as SockIOStream, over AF_UNIX stream sockets.
+class MAA_UTILS_API LocalSockIOStream : public BasicSockIOStream<boost::asio::local::stream_protocol>
+{
+public:
+    using options_type = LocalSockOptions;
+
+public:
+    explicit LocalSockIOStream(boost::asio::local::stream_protocol::iostream&& ios, const LocalSockOptions& options = {});
+};
+
+extern template class MAA_UTILS_API BasicServerSockIOFactory<LocalSockIOStream>;
+extern template class MAA_UTILS_API BasicClientSockIOFactory<LocalSockIOStream>;
+
+// `path` is a socket file, or with `abstract` a name in the Linux abstract namespace, which needs no file.
+// A socket file left by a server that is gone is replaced, anything else at `path` fails the bind and is kept.
+class MAA_UTILS_API ServerLocalSockIOFactory : public BasicServerSockIOFactory<LocalSockIOStream>
+{
+public:
+    explicit ServerLocalSockIOFactory(const std::string& path, bool abstract = false);
+    ~ServerLocalSockIOFactory();
+
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+    bool abstract_ = false;
+    // the socket file at path_ was bound by this factory, so it is removed with it
+    bool owns_path_ = false;
+};
+
+class MAA_UTILS_API ClientLocalSockIOFactory : public BasicClientSockIOFactory<LocalSockIOStream>
+{
+public:
+    explicit ClientLocalSockIOFactory(const std::string& path, bool abstract = false, const LocalSockOptions& options = {});
+    ~ClientLocalSockIOFactory() = default;
+};
+
+MAA_NS_END
+
+#endif
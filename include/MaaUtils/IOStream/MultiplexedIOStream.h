@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "FramedIOStream.h"
+#include "MaaUtils/NonCopyable.hpp"
+#include "MaaUtils/Port.h"
+
+MAA_NS_BEGIN
+
+// Concurrent request / response over one IOStream. Every message is a typed frame tagged with a request id,
+// so any number of threads can have requests in flight; one reader thread completes their futures.
+// Both ends use this class, the peer answers through its RequestHandler.
+// The reader thread reads while other threads write, which the stream must allow, as sockets, pipes and ShmIOStream do.
+class MAA_UTILS_API MultiplexedIOStream : public NonCopyable
+{
+public:
+    // Runs on the reader thread for each request of the peer. Answer with respond(), from any thread,
+    // and hand long work off so the responses behind it are not held up.
+    using RequestHandler = std::function<void(uint64_t id, std::string_view payload)>;
+    using Response = std::optional<std::string>;
+
+public:
+    explicit MultiplexedIOStream(std::shared_ptr<IOStream> stream, RequestHandler on_request = nullptr);
+    // Stops reading through IOStream::shutdown_read(). A stream without it holds this up while the peer is stalled mid-frame.
+    ~MultiplexedIOStream();
+
+public:
+    // nullopt once the stream ends before the response arrives
+    std::future<Response> request(std::string_view payload);
+    bool respond(uint64_t id, std::string_view payload);
+
+    bool is_open() const { return !closed_; }
+
+private:
+    bool send(uint8_t type, uint64_t id, std::string_view payload);
+    void reading();
+    void close_pending();
+
+private:
+    FramedIOStream framed_;
+    RequestHandler on_request_;
+
+    std::mutex write_mutex_;
+
+    std::mutex pending_mutex_;
+    std::unordered_map<uint64_t, std::promise<Response>> pending_;
+    std::atomic<uint64_t> next_id_ = 1;
+
+    std::atomic_bool closed_ = false;
+    std::atomic_bool exit_ = false;
+    std::thread reader_;
+};
+
+MAA_NS_END
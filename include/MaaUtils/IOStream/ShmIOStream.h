@@ -0,0 +1,119 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "IOStream.h"
+#include "MaaUtils/NonCopyable.hpp"
+#include "MaaUtils/Port.h"
+
+MAA_NS_BEGIN
+
+class ChildPipeIOStream;
+struct ShmHeader;
+struct ShmRing;
+
+// Two single-producer / single-consumer byte rings in a memfd region shared by two processes, one per direction.
+// Reads and writes are one memcpy through the ring; futex waits are only entered while the ring is empty (or full),
+// and write_buffered() does not wake the reader until flush().
+// One thread per side may read and one may write at a time.
+// Waits blocked on a peer process that exited without release() notice it within 100 ms, and the stream closes.
+class MAA_UTILS_API ShmIOStream : public IOStream
+{
+public:
+    static constexpr size_t kDefaultCapacity = 4 * 1024 * 1024;
+    // prefix of the argument ShmChildIOFactory passes, followed by the fd number
+    static constexpr std::string_view kFdArgPrefix = "--maa-shm-fd=";
+
+    // The fd is close-on-exec, hand it to a child with ChildPipeOptions::extra_fds, as ShmChildIOFactory does.
+    static std::shared_ptr<ShmIOStream> create(size_t capacity = kDefaultCapacity);
+    static std::shared_ptr<ShmIOStream> attach(int fd);
+    // attach() to the fd passed by ShmChildIOFactory, nullptr if there is none
+    static std::shared_ptr<ShmIOStream> attach_from_args(int argc, const char* const* argv);
+
+    ShmIOStream(const ShmIOStream&) = delete;
+    ShmIOStream(ShmIOStream&&) = delete;
+    ShmIOStream& operator=(const ShmIOStream&) = delete;
+    ShmIOStream& operator=(ShmIOStream&&) = delete;
+
+    virtual ~ShmIOStream() override;
+
+    int fd() const { return fd_; }
+
+public:
+    virtual bool write_buffered(std::string_view data, bool newline = true) override;
+    virtual bool flush() override;
+
+    virtual bool release() override;
+    virtual bool is_open() const override;
+
+protected:
+    virtual std::string read_once(size_t max_count) override;
+    virtual size_t read_once_into(std::span<char> buffer) override;
+    virtual size_t read_available(char* buffer, size_t max_count) override;
+    virtual bool wait_readable(duration_t timeout) override;
+
+private:
+    // `capacity` as validated by create() or attach(), the header is writable by the peer
+    ShmIOStream(int fd, void* base, size_t mapped_size, size_t capacity, bool creator);
+
+    bool write_bytes(std::string_view data);
+    bool wait_space();
+    void close_rings();
+    // false once the process on the other side has exited, checked while a wait is blocked
+    bool peer_alive();
+    void wake_reader();
+
+private:
+    int fd_ = -1;
+    void* base_ = nullptr;
+    size_t mapped_size_ = 0;
+    size_t capacity_ = 0;
+
+    ShmHeader* header_ = nullptr;
+    ShmRing* tx_ = nullptr;
+    char* tx_data_ = nullptr;
+    ShmRing* rx_ = nullptr;
+    char* rx_data_ = nullptr;
+
+    size_t peer_index_ = 0;
+    std::mutex peer_mutex_;
+    int32_t peer_pid_ = 0;
+    int peer_pidfd_ = -1;
+
+    friend class ShmChildIOFactory;
+};
+
+// Starts a child process that shares a new ShmIOStream with the caller.
+class MAA_UTILS_API ShmChildIOFactory : public NonCopyButMovable
+{
+public:
+    struct Child
+    {
+        std::shared_ptr<ShmIOStream> stream;
+        // its stdin / stdout stay usable for control messages
+        std::shared_ptr<ChildPipeIOStream> process;
+    };
+
+public:
+    explicit ShmChildIOFactory(size_t capacity = ShmIOStream::kDefaultCapacity);
+    ~ShmChildIOFactory() = default;
+
+public:
+    // `args` get kFdArgPrefix<fd> appended, the child calls ShmIOStream::attach_from_args() with its argv
+    std::optional<Child> launch(const std::filesystem::path& exec, std::vector<std::string> args);
+
+private:
+    size_t capacity_ = ShmIOStream::kDefaultCapacity;
+};
+
+MAA_NS_END
+
+#endif
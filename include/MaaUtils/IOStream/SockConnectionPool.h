@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "MaaUtils/NonCopyable.hpp"
+#include "MaaUtils/Port.h"
+#include "SockIOStream.h"
+
+MAA_NS_BEGIN
+
+struct SockPoolOptions
+{
+    using duration_t = IOStream::duration_t;
+
+    SockOptions sock;
+
+    // per endpoint
+    size_t max_idle = 8;
+    // leased, idle and connecting per endpoint, 0 for no limit; acquire() waits up to `acquire_timeout` for a slot
+    size_t max_connections = 0;
+    duration_t acquire_timeout = std::chrono::seconds(5);
+    // idle connections older than this are closed instead of handed out
+    duration_t idle_timeout = std::chrono::seconds(60);
+
+    // a failed connect is retried after a jittered exponential backoff
+    size_t connect_attempts = 5;
+    duration_t backoff_initial = std::chrono::milliseconds(50);
+    duration_t backoff_max = std::chrono::seconds(2);
+};
+
+// Keeps connected SockIOStreams per endpoint, so repeated short exchanges with the same agent skip the handshake.
+class MAA_UTILS_API SockConnectionPool : public NonCopyable
+{
+public:
+    // run on an idle connection before it is handed out again, after the built-in probe_idle(); false drops it
+    using Validator = std::function<bool(SockIOStream&)>;
+
+public:
+    explicit SockConnectionPool(SockPoolOptions options = {}, Validator validator = nullptr);
+    ~SockConnectionPool();
+
+public:
+    // The most recently returned live connection, otherwise a new one. Dropping the last copy of the lease returns
+    // the connection; release() it instead if the exchange was left unfinished. nullptr if connecting fails.
+    std::shared_ptr<SockIOStream> acquire(const std::string& address, uint16_t port);
+
+    size_t idle_count(const std::string& address, uint16_t port) const;
+
+private:
+    struct State;
+
+private:
+    std::shared_ptr<State> state_;
+};
+
+MAA_NS_END
@@ -1,74 +1,63 @@
 #pragma once
 
-#include <memory>
-
-#include "IOStream.h"
+#include "BasicSockIOStream.h"
 #include "MaaUtils/Port.h"
-#include "MaaUtils/NonCopyable.hpp"
 
 MAA_NS_BEGIN
 
-class MAA_UTILS_API SockIOStream;
-
-class MAA_UTILS_API ServerSockIOFactory : public NonCopyButMovable
+// Socket options of every stream a factory produces. Zero keeps the system default.
+struct SockOptions
 {
-public:
-    ServerSockIOFactory(const std::string& address, uint16_t port);
-    ~ServerSockIOFactory();
-
-    uint16_t port() const;
-
-public:
-    std::shared_ptr<SockIOStream> accept();
-
-private:
-    boost::asio::io_context io_ctx_;
-    boost::asio::ip::tcp::acceptor server_acceptor_;
+    // small request / response messages otherwise wait for Nagle and delayed ACKs, up to 40 ms
+    bool no_delay = true;
+    int send_buffer = 0;
+    int receive_buffer = 0;
+
+    bool keep_alive = false;
+    std::chrono::seconds keep_alive_idle { 0 };
+    std::chrono::seconds keep_alive_interval { 0 };
+    int keep_alive_count = 0;
+
+    // client only
+    IOStream::duration_t connect_timeout = IOStream::duration_t::max();
+    // Linux only, re-armed after every read since the kernel drops it on its own
+    bool quick_ack = false;
 };
 
-class MAA_UTILS_API ClientSockIOFactory : public NonCopyButMovable
+extern template class MAA_UTILS_API BasicSockIOStream<boost::asio::ip::tcp>;
+
+class MAA_UTILS_API SockIOStream : public BasicSockIOStream<boost::asio::ip::tcp>
 {
 public:
-    ClientSockIOFactory(const std::string& address, unsigned short port);
-    ~ClientSockIOFactory() = default;
+    using options_type = SockOptions;
 
 public:
-    std::shared_ptr<SockIOStream> connect();
+    explicit SockIOStream(boost::asio::ip::tcp::iostream&& ios, const SockOptions& options = {});
+
+protected:
+    virtual void after_read() override;
 
 private:
-    boost::asio::io_context io_ctx_;
-    boost::asio::ip::tcp::endpoint endpoint_;
+    bool quick_ack_ = false;
 };
 
-class MAA_UTILS_API SockIOStream : public IOStream
+extern template class MAA_UTILS_API BasicServerSockIOFactory<SockIOStream>;
+extern template class MAA_UTILS_API BasicClientSockIOFactory<SockIOStream>;
+
+class MAA_UTILS_API ServerSockIOFactory : public BasicServerSockIOFactory<SockIOStream>
 {
 public:
-    explicit SockIOStream(boost::asio::ip::tcp::iostream&& ios);
-
-    // NonCopyButMovable
-    // https://stackoverflow.com/questions/29289956/c11-virtual-destructors-and-auto-generation-of-move-special-functions
-    SockIOStream(const SockIOStream&) = delete;
-    SockIOStream(SockIOStream&&) = default;
-    SockIOStream& operator=(const SockIOStream&) = delete;
-    SockIOStream& operator=(SockIOStream&&) = default;
+    ServerSockIOFactory(const std::string& address, uint16_t port, const SockOptions& options = {});
+    ~ServerSockIOFactory() = default;
 
-    virtual ~SockIOStream() override;
+    uint16_t port() const;
+};
 
+class MAA_UTILS_API ClientSockIOFactory : public BasicClientSockIOFactory<SockIOStream>
+{
 public:
-    virtual bool write(std::string_view data) override;
-
-    virtual bool release() override;
-    virtual bool is_open() const override;
-
-    void expires_after(duration_t timeout);
-
-protected:
-    virtual std::string read_once(size_t max_count) override;
-
-private:
-    boost::asio::ip::tcp::iostream ios_;
-
-    std::unique_ptr<char[]> buffer_ = nullptr;
+    ClientSockIOFactory(const std::string& address, unsigned short port, const SockOptions& options = {});
+    ~ClientSockIOFactory() = default;
 };
 
 MAA_NS_END
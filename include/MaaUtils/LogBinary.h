@@ -0,0 +1,214 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "MaaUtils/Conf.h"
+
+// Layout of maa.binlog, shared by Logger and the offline decoder (tools/LogDecoder).
+//
+// file   := magic version:u32 record*
+// record := kind:u8 size:u32 body[size]
+// site   := id:varint count:varint text:bytes{count}     // the props of a call site, e.g. LOG_ARGS
+// entry  := site:varint time:varint pid:varint tid:varint level:u8 sep arg*
+// arg    := kind:u8 payload sep
+// sep    := index:u8 [text:bytes if index == kSepCustom]
+//
+// time is local_now_millis().
+//
+// Integers are little endian, bytes := size:varint data[size]. A site is written before its first entry
+// and again at the top of every new file; a later definition of the same id replaces the earlier one.
+
+MAA_LOG_NS_BEGIN
+
+namespace binlog
+{
+inline constexpr std::string_view kMagic = "MAABLOG1";
+inline constexpr uint32_t kVersion = 1;
+
+enum class record_kind : uint8_t
+{
+    site = 1,
+    entry = 2,
+};
+
+inline constexpr size_t kRecordHeaderSize = 1 + sizeof(uint32_t);
+
+enum class arg_kind : uint8_t
+{
+    text = 0,    // bytes
+    sint = 1,    // zigzag varint
+    uint = 2,    // varint
+    real = 3,    // f64
+    boolean = 4, // u8
+};
+
+// index of separator::none, space, tab, newline, comma
+inline constexpr std::string_view kSeparators[] = { "", " ", "\t", "\n", "," };
+inline constexpr uint8_t kSepCustom = 0xFF;
+
+inline void put_u8(std::string& out, uint8_t value)
+{
+    out.push_back(static_cast<char>(value));
+}
+
+inline void put_u32(std::string& out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+inline void put_varint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline void put_zigzag(std::string& out, int64_t value)
+{
+    put_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+inline void put_f64(std::string& out, double value)
+{
+    auto bits = std::bit_cast<uint64_t>(value);
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((bits >> (i * 8)) & 0xFF));
+    }
+}
+
+inline void put_bytes(std::string& out, std::string_view bytes)
+{
+    put_varint(out, bytes.size());
+    out.append(bytes);
+}
+
+inline void put_separator(std::string& out, std::string_view sep)
+{
+    for (size_t i = 0; i < std::size(kSeparators); ++i) {
+        if (sep == kSeparators[i]) {
+            put_u8(out, static_cast<uint8_t>(i));
+            return;
+        }
+    }
+    put_u8(out, kSepCustom);
+    put_bytes(out, sep);
+}
+
+// Appends the header of a record whose body follows, finish_record() fills in the size.
+inline size_t begin_record(std::string& out, record_kind kind)
+{
+    size_t pos = out.size();
+    put_u8(out, static_cast<uint8_t>(kind));
+    put_u32(out, 0);
+    return pos;
+}
+
+inline void finish_record(std::string& out, size_t pos)
+{
+    auto size = static_cast<uint32_t>(out.size() - pos - kRecordHeaderSize);
+    for (int i = 0; i < 4; ++i) {
+        out[pos + 1 + i] = static_cast<char>((size >> (i * 8)) & 0xFF);
+    }
+}
+
+// Bounds-checked cursor over a record body, ok() turns false on the first short read.
+class Reader
+{
+public:
+    explicit Reader(std::string_view data)
+        : data_(data)
+    {
+    }
+
+    bool ok() const { return ok_; }
+
+    bool empty() const { return pos_ >= data_.size(); }
+
+    uint8_t u8()
+    {
+        if (!require(1)) {
+            return 0;
+        }
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+
+    uint32_t u32()
+    {
+        if (!require(4)) {
+            return 0;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(data_[pos_++])) << (i * 8);
+        }
+        return value;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = u8();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        ok_ = false;
+        return 0;
+    }
+
+    int64_t zigzag()
+    {
+        uint64_t value = varint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    double f64()
+    {
+        if (!require(8)) {
+            return 0;
+        }
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; ++i) {
+            bits |= static_cast<uint64_t>(static_cast<uint8_t>(data_[pos_++])) << (i * 8);
+        }
+        return std::bit_cast<double>(bits);
+    }
+
+    std::string_view bytes()
+    {
+        auto size = varint();
+        if (!require(size)) {
+            return {};
+        }
+        auto result = data_.substr(pos_, size);
+        pos_ += size;
+        return result;
+    }
+
+private:
+    bool require(uint64_t size)
+    {
+        if (!ok_ || data_.size() - pos_ < size) {
+            ok_ = false;
+        }
+        return ok_;
+    }
+
+    std::string_view data_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+}
+
+MAA_LOG_NS_END
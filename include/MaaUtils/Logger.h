@@ -1,22 +1,83 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 #include "MaaUtils/LoggerUtils.h"
 #include "MaaUtils/ScopeLeave.hpp"
+#include "MaaUtils/Tracer.h"
+
+// Statements more verbose than this level are compiled out, e.g. -DMAA_LOG_MIN_LEVEL=4 keeps info and above.
+// Debug builds keep everything, other builds drop debug and trace.
+#ifndef MAA_LOG_MIN_LEVEL
+#ifdef MAA_DEBUG
+#define MAA_LOG_MIN_LEVEL 7
+#else
+#define MAA_LOG_MIN_LEVEL 4
+#endif
+#endif
 
 MAA_LOG_NS_BEGIN
 
+// what an async logger does when its queue is full
+enum class overflow_policy
+{
+    block,
+    drop_oldest,
+    drop_newest,
+};
+
+struct ImageDumpOptions
+{
+    // picks the codec
+    std::string extension = ".png";
+    // png compression level 0-9, jpeg / webp quality 0-100, -1 keeps the codec default
+    int quality = -1;
+    // the oldest dumps are deleted once the dumps directory grows past this
+    uintmax_t max_bytes = 1024ULL * 1024 * 1024;
+    size_t workers = 1;
+    // images waiting to be encoded, further dumps are skipped while full
+    size_t max_pending = 64;
+};
+
+struct LogRotationOptions
+{
+    // rotated once maa.log reaches this size
+    uintmax_t max_size = 16ULL * 1024 * 1024;
+    // maa.bak.log, maa.bak.2.log, ... 0 drops the old log
+    size_t generations = 1;
+    // gzip each rotated generation on a background thread, ignored in builds without zlib
+    bool compress = false;
+};
+
+class LogQueue;
+struct LogRecord;
+class ImageDumper;
+class LogSiteLimiter;
+
 class MAA_UTILS_API Logger
 {
 public:
     static constexpr std::string_view kLogFilename = "maa.log";
     static constexpr std::string_view kLogbakFilename = "maa.bak.log";
+    static constexpr std::string_view kBinlogFilename = "maa.binlog";
+    static constexpr std::string_view kJsonlFilename = "maa.jsonl";
     static constexpr std::string_view kDumpsDirname = "dumps";
     static constexpr std::string_view kDumpsbakDirname = "dumps.bak";
 
+    static constexpr size_t kDefaultQueueCapacity = 8192;
+
 public:
     static Logger& get_instance();
 
-    ~Logger() { close(); }
+    ~Logger();
 
     Logger(const Logger&) = delete;
     Logger(Logger&&) = delete;
@@ -61,30 +122,90 @@ public:
 
     void start_logging(std::filesystem::path dir);
     void set_stdout_level(level lv);
+    void set_file_level(level lv);
+    // Binary logs store call sites once and arguments unformatted, JSON lines keep VAR() values as fields.
+    // Set it before start_logging().
+    void set_file_format(log_format format);
+
+    bool enabled(level lv) const { return lv <= stdout_level_ || lv <= file_level_; }
+
+    // In async mode LogStream only enqueues its record, a writer thread does the I/O in batches.
+    // Turn it off before unloading the library so the writer thread is joined in time.
+    void set_async(bool async, size_t queue_capacity = kDefaultQueueCapacity);
+    void set_overflow_policy(overflow_policy policy);
+
+    void set_rotation_options(LogRotationOptions options);
+
+    // cv::Mat arguments are hashed and encoded on background threads, identical images are written once
+    void set_dump_options(ImageDumpOptions options);
+
+    // Waits until every record committed before the call is written to the file.
+    // Statements held back by LogXxxEvery / LogXxxRateLimited are reported first.
     void flush();
 
 private:
+    friend class LogStream;
+    friend class StringConverter;
+    friend class LogSiteLimiter;
+
     template <typename... args_t>
     LogStream stream(level lv, args_t&&... args)
     {
-        count_and_check_flush();
+        if (proc_info_pending_.load(std::memory_order_relaxed) && proc_info_pending_.exchange(false)) {
+            log_proc_info();
+        }
 
         bool std_out = lv <= stdout_level_;
-        return LogStream(trace_mutex_, ofs_, lv, std_out, dumps_dir_, std::forward<args_t>(args)...);
+        bool to_file = lv <= file_level_;
+        auto format = file_format_.load(std::memory_order_relaxed);
+        return LogStream(*this, lv, std_out, to_file, format, std::forward<args_t>(args)...);
     }
 
+    // `structured` (a binlog entry or JSON line) replaces the text line in the file when not empty.
+    // In async mode the strings are moved into the queue, otherwise they are left as they are.
+    void commit(level lv, bool std_out, bool to_file, std::string&& text, std::string&& structured = {});
+    void commit(level lv, bool std_out, bool to_file, std::string_view text, std::string_view structured = {});
+    uint32_t binary_site(std::span<const std::string_view> props);
+
 private:
     Logger() = default;
 
     void reinit();
-    bool rotate();
-    void open(bool append = true);
     void close();
     void log_proc_info();
-    void count_and_check_flush();
+
+    // the following require trace_mutex_
+    void rotate();
+    void open(bool append = true);
+    std::filesystem::path backup_path(size_t generation) const;
+    std::filesystem::path file_path() const;
+    void write_binary_header();
+    void write_binary_site(uint32_t id);
+
+    static void compress_file(std::filesystem::path file);
+
+    void write_in_place(level lv, bool std_out, bool to_file, std::string_view text, std::string_view structured);
+
+    // false if async mode is off, the caller writes in place then
+    bool try_enqueue(LogRecord& record);
+    bool enqueue(LogRecord& record);
+    bool push_blocking(LogRecord& record);
+    bool push_dropping_oldest(LogRecord& record);
+    void start_writer();
+    void stop_writer();
+    void writer_loop();
+    size_t write_queued();
+    void write_batch(std::string_view file_batch, std::string_view stdout_batch);
+
+    std::string dump_image(const cv::Mat& image);
+    ImageDumper& dumper();
 
     LogStream internal_dbg();
 
+    void add_limiter(LogSiteLimiter* limiter);
+    void remove_limiter(LogSiteLimiter* limiter);
+    void report_limiters();
+
 private:
     std::filesystem::path log_dir_;
     std::filesystem::path log_path_;
@@ -95,10 +216,36 @@ private:
 #else
     level stdout_level_ = level::error;
 #endif
+    level file_level_ = level::all;
     std::ofstream ofs_;
     std::mutex trace_mutex_;
 
-    size_t log_count_ = 0;
+    LogRotationOptions rotation_;
+    uintmax_t bytes_written_ = 0;
+    std::atomic_bool proc_info_pending_ = false;
+    std::future<void> compress_future_;
+
+    std::atomic<log_format> file_format_ = log_format::text;
+    // call site props joined by '\0', indexed by site id
+    std::vector<std::string> binary_sites_;
+    std::unordered_map<std::string, uint32_t> binary_site_ids_;
+
+    std::mutex limiters_mutex_;
+    std::vector<LogSiteLimiter*> limiters_;
+
+    std::atomic_bool async_ = false;
+    // threads inside try_enqueue(), set_async(false) waits for them before it stops the writer
+    std::atomic_size_t producers_ = 0;
+    std::atomic<overflow_policy> overflow_policy_ = overflow_policy::block;
+    std::unique_ptr<LogQueue> queue_;
+    std::thread writer_;
+    std::atomic_bool writer_running_ = false;
+    std::atomic_size_t wake_seq_ = 0;
+    std::atomic_size_t popped_ = 0;
+    std::atomic_size_t dropped_ = 0;
+
+    std::unique_ptr<ImageDumper> dumper_;
+    std::once_flag dumper_once_;
 };
 
 class LogScopeEnterHelper
@@ -125,17 +272,100 @@ public:
     explicit LogScopeLeaveHelper(args_t&&... args)
         : args_(std::forward<args_t>(args)...)
     {
+        if (enabled_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+        if (traced_) {
+            Tracer::begin(trace_name());
+        }
     }
 
     ~LogScopeLeaveHelper()
     {
+        if (traced_) {
+            Tracer::end(trace_name());
+        }
+        if (!enabled_) {
+            return;
+        }
         std::apply([](auto&&... args) { return Logger::get_instance().trace(std::forward<decltype(args)>(args)...); }, std::move(args_))
             << "| leave," << duration_since(start_);
     }
 
+private:
+    // the function of LOG_ARGS
+    std::string_view trace_name() const
+    {
+        if constexpr (sizeof...(args_t) > 0) {
+            return std::string_view(std::get<sizeof...(args_t) - 1>(args_));
+        }
+        else {
+            return "scope";
+        }
+    }
+
 private:
     std::tuple<args_t...> args_;
-    std::chrono::time_point<std::chrono::steady_clock> start_ = std::chrono::steady_clock::now();
+    const bool enabled_ = static_cast<int>(level::trace) <= MAA_LOG_MIN_LEVEL && Logger::get_instance().enabled(level::trace);
+    const bool traced_ = Tracer::enabled();
+    std::chrono::time_point<std::chrono::steady_clock> start_;
+};
+
+// State of one LogXxxEvery / LogXxxRateLimited statement, a function-local static per call site.
+// Statements held back are counted and reported as "suppressed K messages" at the same level and call site,
+// when the next statement passes or the next second starts, and on Logger::flush() and shutdown.
+class MAA_UTILS_API LogSiteLimiter
+{
+public:
+    LogSiteLimiter(level lv, std::string_view file, std::string_view line, std::string_view function);
+    ~LogSiteLimiter();
+
+    // passes the 1st, (n+1)th, (2n+1)th... statement
+    bool every(size_t n)
+    {
+        if (count_.fetch_add(1, std::memory_order_relaxed) % std::max<size_t>(n, 1) != 0) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        report();
+        return true;
+    }
+
+    // a token bucket refilled to `per_sec` once a second
+    bool per_second(size_t per_sec)
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        auto window = window_.load(std::memory_order_relaxed);
+        if (now - window >= kWindow && window_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+            count_.store(0, std::memory_order_relaxed);
+            report();
+        }
+
+        if (count_.fetch_add(1, std::memory_order_relaxed) >= per_sec) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    friend class Logger;
+
+    // writes and resets the suppressed count, if any
+    void report();
+
+private:
+    static constexpr auto kWindow =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)).count();
+
+    const level lv_;
+    const std::string_view file_;
+    const std::string_view line_;
+    const std::string_view function_;
+
+    std::atomic_size_t count_ = 0;
+    std::atomic_size_t suppressed_ = 0;
+    std::atomic<std::chrono::steady_clock::rep> window_ = 0;
 };
 
 inline constexpr std::string_view pertty_file(std::string_view file)
@@ -159,18 +389,54 @@ MAA_LOG_NS_END
 #endif
 #define LOG_ARGS MAA_FILE, MAA_LINE, MAA_FUNCTION
 
-#define LogFatal MAA_LOG_NS::Logger::get_instance().fatal(LOG_ARGS)
-#define LogError MAA_LOG_NS::Logger::get_instance().error(LOG_ARGS)
-#define LogWarn MAA_LOG_NS::Logger::get_instance().warn(LOG_ARGS)
-#define LogInfo MAA_LOG_NS::Logger::get_instance().info(LOG_ARGS)
-#define LogDebug MAA_LOG_NS::Logger::get_instance().debug(LOG_ARGS)
-#define LogTrace MAA_LOG_NS::Logger::get_instance().trace(LOG_ARGS)
+// Disabled statements skip the whole `<<` chain, so arguments are not evaluated.
+// A one-shot for loop rather than if/else keeps `if (x) LogInfo << y; else ...` free of dangling-else warnings.
+#define MAA_LOG_ENABLED(lv) \
+    (static_cast<int>(MAA_LOG_NS::level::lv) <= MAA_LOG_MIN_LEVEL && MAA_LOG_NS::Logger::get_instance().enabled(MAA_LOG_NS::level::lv))
+#define MAA_LOG_IF(lv) for (bool maa_log_once_ = MAA_LOG_ENABLED(lv); maa_log_once_; maa_log_once_ = false)
+
+// Each expansion is a distinct lambda, so each call site gets its own limiter.
+// The site is passed in, LOG_ARGS inside the lambda would name the lambda rather than the caller.
+#define MAA_LOG_SITE_LIMITER(lv)                                                                            \
+    ([](std::string_view maa_log_file_, std::string_view maa_log_line_, std::string_view maa_log_function_) \
+         -> MAA_LOG_NS::LogSiteLimiter& {                                                                   \
+        static MAA_LOG_NS::LogSiteLimiter                                                                   \
+            maa_log_limiter_(MAA_LOG_NS::level::lv, maa_log_file_, maa_log_line_, maa_log_function_);       \
+        return maa_log_limiter_;                                                                            \
+    }(LOG_ARGS))
+#define MAA_LOG_EVERY_IF(lv, n) \
+    for (bool maa_log_once_ = MAA_LOG_ENABLED(lv) && MAA_LOG_SITE_LIMITER(lv).every(n); maa_log_once_; maa_log_once_ = false)
+#define MAA_LOG_RATE_IF(lv, per_sec) \
+    for (bool maa_log_once_ = MAA_LOG_ENABLED(lv) && MAA_LOG_SITE_LIMITER(lv).per_second(per_sec); maa_log_once_; maa_log_once_ = false)
+
+#define LogFatal MAA_LOG_IF(fatal) MAA_LOG_NS::Logger::get_instance().fatal(LOG_ARGS)
+#define LogError MAA_LOG_IF(error) MAA_LOG_NS::Logger::get_instance().error(LOG_ARGS)
+#define LogWarn MAA_LOG_IF(warn) MAA_LOG_NS::Logger::get_instance().warn(LOG_ARGS)
+#define LogInfo MAA_LOG_IF(info) MAA_LOG_NS::Logger::get_instance().info(LOG_ARGS)
+#define LogDebug MAA_LOG_IF(debug) MAA_LOG_NS::Logger::get_instance().debug(LOG_ARGS)
+#define LogTrace MAA_LOG_IF(trace) MAA_LOG_NS::Logger::get_instance().trace(LOG_ARGS)
+
+// LogWarnEvery(100) << ...; logs the 1st of every 100 times the statement runs.
+#define LogFatalEvery(n) MAA_LOG_EVERY_IF(fatal, n) MAA_LOG_NS::Logger::get_instance().fatal(LOG_ARGS)
+#define LogErrorEvery(n) MAA_LOG_EVERY_IF(error, n) MAA_LOG_NS::Logger::get_instance().error(LOG_ARGS)
+#define LogWarnEvery(n) MAA_LOG_EVERY_IF(warn, n) MAA_LOG_NS::Logger::get_instance().warn(LOG_ARGS)
+#define LogInfoEvery(n) MAA_LOG_EVERY_IF(info, n) MAA_LOG_NS::Logger::get_instance().info(LOG_ARGS)
+#define LogDebugEvery(n) MAA_LOG_EVERY_IF(debug, n) MAA_LOG_NS::Logger::get_instance().debug(LOG_ARGS)
+#define LogTraceEvery(n) MAA_LOG_EVERY_IF(trace, n) MAA_LOG_NS::Logger::get_instance().trace(LOG_ARGS)
+
+// LogErrorRateLimited(10) << ...; logs at most 10 times per second and reports how many were dropped.
+#define LogFatalRateLimited(per_sec) MAA_LOG_RATE_IF(fatal, per_sec) MAA_LOG_NS::Logger::get_instance().fatal(LOG_ARGS)
+#define LogErrorRateLimited(per_sec) MAA_LOG_RATE_IF(error, per_sec) MAA_LOG_NS::Logger::get_instance().error(LOG_ARGS)
+#define LogWarnRateLimited(per_sec) MAA_LOG_RATE_IF(warn, per_sec) MAA_LOG_NS::Logger::get_instance().warn(LOG_ARGS)
+#define LogInfoRateLimited(per_sec) MAA_LOG_RATE_IF(info, per_sec) MAA_LOG_NS::Logger::get_instance().info(LOG_ARGS)
+#define LogDebugRateLimited(per_sec) MAA_LOG_RATE_IF(debug, per_sec) MAA_LOG_NS::Logger::get_instance().debug(LOG_ARGS)
+#define LogTraceRateLimited(per_sec) MAA_LOG_RATE_IF(trace, per_sec) MAA_LOG_NS::Logger::get_instance().trace(LOG_ARGS)
 
 #define LogFunc                                                   \
     MAA_LOG_NS::LogScopeLeaveHelper ScopeHelperVarName(LOG_ARGS); \
-    MAA_LOG_NS::LogScopeEnterHelper(LOG_ARGS)()
+    MAA_LOG_IF(debug) MAA_LOG_NS::LogScopeEnterHelper(LOG_ARGS)()
 
 #define VAR_RAW(x) "[" << #x << "=" << (x) << "] "
-#define VAR(x) MAA_LOG_NS::separator::none << VAR_RAW(x) << MAA_LOG_NS::separator::space
+#define VAR(x) MAA_LOG_NS::LogVar(#x, (x))
 #define VAR_VOIDP_RAW(x) "[" << #x << "=" << reinterpret_cast<void*>(x) << "] "
-#define VAR_VOIDP(x) MAA_LOG_NS::separator::none << VAR_VOIDP_RAW(x) << MAA_LOG_NS::separator::space
+#define VAR_VOIDP(x) MAA_LOG_NS::LogVar(#x, reinterpret_cast<void*>(x))
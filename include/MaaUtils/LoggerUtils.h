@@ -4,11 +4,16 @@
 #include <unistd.h>
 #endif
 
+#include <array>
+#include <charconv>
+#include <cmath>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <mutex>
+#include <span>
 #include <sstream>
 #include <thread>
 #include <type_traits>
@@ -17,6 +22,8 @@
 
 #include "MaaUtils/Port.h"
 #include "MaaUtils/Conf.h"
+#include "MaaUtils/LogBinary.h"
+#include "MaaUtils/ScopeLeave.hpp"
 #include "MaaUtils/Time.hpp"
 
 namespace cv
@@ -45,6 +52,14 @@ enum class level
     all = 7,
 };
 
+// what goes into the log file, binary logs are rendered offline by MaaLogDecoder
+enum class log_format
+{
+    text,
+    binary,
+    json_lines,
+};
+
 struct MAA_UTILS_API separator
 {
     explicit constexpr separator(std::string_view s) noexcept
@@ -64,14 +79,139 @@ struct MAA_UTILS_API separator
 template <typename T>
 concept has_output_operator = requires { std::declval<std::ostream&>() << std::declval<T>(); };
 
-class MAA_UTILS_API StringConverter
+// VAR(x), rendered as "[x=...] " in text and as a field of "vars" in JSON lines
+template <typename T>
+struct LogVar
+{
+    LogVar(std::string_view n, const T& v)
+        : name(n)
+        , value(v)
+    {
+    }
+
+    std::string_view name;
+    const T& value;
+};
+
+template <typename T>
+inline constexpr bool is_log_var = false;
+template <typename T>
+inline constexpr bool is_log_var<LogVar<T>> = true;
+
+// Appends `str` escaped for the inside of a JSON string literal.
+inline void append_json_escaped(std::string& out, std::string_view str)
+{
+    constexpr char kHex[] = "0123456789abcdef";
+
+    size_t plain = 0;
+    for (size_t i = 0; i < str.size(); ++i) {
+        auto ch = static_cast<unsigned char>(str[i]);
+        if (ch >= 0x20 && ch != '"' && ch != '\\') {
+            continue;
+        }
+
+        out.append(str.substr(plain, i - plain));
+        plain = i + 1;
+
+        out.push_back('\\');
+        switch (ch) {
+        case '"':
+        case '\\':
+            out.push_back(static_cast<char>(ch));
+            break;
+        case '\n':
+            out.push_back('n');
+            break;
+        case '\r':
+            out.push_back('r');
+            break;
+        case '\t':
+            out.push_back('t');
+            break;
+        default:
+            out.append("u00");
+            out.push_back(kHex[ch >> 4]);
+            out.push_back(kHex[ch & 0xF]);
+            break;
+        }
+    }
+    out.append(str.substr(plain));
+}
+
+// Formatting buffers are recycled per thread, so a warmed-up thread formats a log line without allocating.
+struct MAA_UTILS_API LogBufferPool
+{
+    static std::string acquire();
+    static void release(std::string&& buffer);
+};
+
+// An ostream writing straight into a std::string, `operator<<` of user types needs no temporary stringstream.
+class StringAppendStream
+    : private std::streambuf
+    , public std::ostream
 {
 public:
-    StringConverter(std::filesystem::path dumps_dir)
-        : dumps_dir_(std::move(dumps_dir))
+    StringAppendStream()
+        : std::ostream(static_cast<std::streambuf*>(this))
+    {
+    }
+
+    bool attached() const { return target_ != nullptr; }
+
+    void attach(std::string& target)
+    {
+        target_ = &target;
+        clear();
+        flags(std::ios_base::skipws | std::ios_base::dec);
+        precision(6);
+        width(0);
+        fill(' ');
+    }
+
+    void detach() { target_ = nullptr; }
+
+protected:
+    using traits = std::streambuf::traits_type;
+
+    virtual std::streambuf::int_type overflow(std::streambuf::int_type ch) override
+    {
+        if (!traits::eq_int_type(ch, traits::eof())) {
+            target_->push_back(traits::to_char_type(ch));
+        }
+        return traits::not_eof(ch);
+    }
+
+    virtual std::streamsize xsputn(const char* s, std::streamsize count) override
     {
+        target_->append(s, static_cast<size_t>(count));
+        return count;
+    }
+
+private:
+    std::string* target_ = nullptr;
+};
+
+// nullptr once the thread's stream is destroyed, e.g. when logging from a static destructor
+inline StringAppendStream* thread_append_stream()
+{
+    thread_local bool destroyed = false;
+    if (destroyed) {
+        return nullptr;
     }
 
+    struct Holder
+    {
+        ~Holder() { destroyed = true; }
+
+        StringAppendStream stream;
+    };
+
+    thread_local Holder holder;
+    return &holder.stream;
+}
+
+class MAA_UTILS_API StringConverter
+{
 public:
     std::string operator()(const std::filesystem::path& path) const;
     std::string operator()(const std::wstring& wstr) const;
@@ -90,12 +230,9 @@ public:
     requires has_output_operator<T>
     std::string operator()(const T& value) const
     {
-        std::stringstream ss;
-        if constexpr (std::same_as<bool, std::decay_t<T>>) {
-            ss << std::boolalpha;
-        }
-        ss << value;
-        return std::move(ss).str();
+        std::string result;
+        append_streamable(result, value);
+        return result;
     }
 
     template <typename T>
@@ -112,10 +249,79 @@ public:
         static_assert(!sizeof(T), "Function type is not supported.");
     }
 
+    // Appends the same text operator() returns, without the intermediate string where possible.
+    template <typename T>
+    void append(std::string& buffer, const T& value) const
+    {
+        if constexpr (std::same_as<T, std::filesystem::path> || std::same_as<T, std::wstring> || std::same_as<T, cv::Mat>) {
+            buffer.append(this->operator()(value));
+        }
+        else if constexpr (has_output_operator<T>) {
+            append_streamable(buffer, value);
+        }
+        else {
+            buffer.append(this->operator()(value));
+        }
+    }
+
+    template <typename T>
+    void append(std::string& buffer, const std::optional<T>& value) const
+    {
+        if (!value) {
+            buffer.append("nullopt");
+            return;
+        }
+        append(buffer, *value);
+    }
+
 private:
-    const std::filesystem::path dumps_dir_;
+    template <typename T>
+    static void append_streamable(std::string& buffer, const T& value)
+    {
+        if constexpr (std::same_as<T, bool>) {
+            buffer.append(value ? "true" : "false");
+        }
+        else if constexpr (std::same_as<T, char>) {
+            buffer.push_back(value);
+        }
+        else if constexpr (std::integral<T> && !std::same_as<T, signed char> && !std::same_as<T, unsigned char>) {
+            char digits[24] = {};
+            auto result = std::to_chars(std::begin(digits), std::end(digits), value);
+            buffer.append(digits, result.ptr);
+        }
+        else if constexpr (std::same_as<T, std::string> || std::same_as<T, std::string_view>) {
+            buffer.append(value);
+        }
+        else if constexpr (std::is_array_v<T> && std::same_as<std::remove_cv_t<std::remove_extent_t<T>>, char>) {
+            buffer.append(std::string_view(value));
+        }
+        else if constexpr (std::same_as<std::decay_t<T>, const char*> || std::same_as<std::decay_t<T>, char*>) {
+            if (value) {
+                buffer.append(value);
+            }
+        }
+        else {
+            auto write = [&](StringAppendStream& stream) {
+                stream.attach(buffer);
+                OnScopeLeave([&]() { stream.detach(); });
+                stream << value;
+            };
+
+            auto* stream = thread_append_stream();
+            if (stream && !stream->attached()) {
+                write(*stream);
+            }
+            else {
+                // nested formatting from inside an operator<<, or too late in thread exit
+                StringAppendStream local;
+                write(local);
+            }
+        }
+    }
 };
 
+class Logger;
+
 template <typename T>
 concept string_convertible = requires { std::declval<StringConverter>()(std::declval<T>()); };
 
@@ -123,12 +329,14 @@ class MAA_UTILS_API LogStream
 {
 public:
     template <typename... args_t>
-    LogStream(std::mutex& m, std::ofstream& s, level lv, bool std_out, std::filesystem::path dumps_dir, args_t&&... args)
-        : mutex_(m)
-        , stream_(s)
+    LogStream(Logger& logger, level lv, bool std_out, bool to_file, log_format format, args_t&&... args)
+        : logger_(logger)
         , lv_(lv)
         , stdout_(std_out)
-        , string_converter_(std::move(dumps_dir))
+        , file_(to_file)
+        , binary_(to_file && format == log_format::binary)
+        , json_(to_file && format == log_format::json_lines)
+        , text_(std_out || (to_file && format == log_format::text))
     {
         stream_props(std::forward<args_t>(args)...);
     }
@@ -136,15 +344,7 @@ public:
     LogStream(const LogStream&) = delete;
     LogStream(LogStream&&) noexcept = default;
 
-    ~LogStream()
-    {
-        std::unique_lock lock(mutex_);
-
-        if (stdout_) {
-            std::cout << stdout_string() << std::endl;
-        }
-        stream_ << std::move(buffer_).str() << std::endl;
-    }
+    ~LogStream();
 
     template <typename T>
     LogStream& operator<<(T&& value)
@@ -152,6 +352,9 @@ public:
         if constexpr (std::is_same_v<std::decay_t<T>, separator>) {
             sep_ = std::forward<T>(value);
         }
+        else if constexpr (is_log_var<std::decay_t<T>>) {
+            stream_var(value.name, value.value);
+        }
         else {
             stream(std::forward<T>(value), sep_);
         }
@@ -168,15 +371,160 @@ public:
 private:
     template <typename T>
     void stream(T&& value, const separator& sep)
+    {
+        if (text_) {
+            append_text(buffer_, value);
+            buffer_.append(sep.str);
+        }
+        if (binary_) {
+            append_binary(value);
+            binlog::put_separator(record_, sep.str);
+        }
+        if (json_) {
+            if constexpr (std::same_as<T, std::string> || std::same_as<T, std::string_view>) {
+                append_json_escaped(message_, value);
+            }
+            else {
+                std::string text = LogBufferPool::acquire();
+                append_text(text, value);
+                append_json_escaped(message_, text);
+                LogBufferPool::release(std::move(text));
+            }
+            append_json_escaped(message_, sep.str);
+        }
+    }
+
+    // same output as the old `separator::none << "[x=" << x << "] " << separator::space` expansion
+    template <typename T>
+    void stream_var(std::string_view name, const T& value)
+    {
+        if (text_) {
+            buffer_.push_back('[');
+            buffer_.append(name);
+            buffer_.push_back('=');
+            append_text(buffer_, value);
+            buffer_.append("] ");
+        }
+        if (binary_) {
+            binlog::put_u8(record_, static_cast<uint8_t>(binlog::arg_kind::text));
+            binlog::put_bytes(record_, "[");
+            binlog::put_separator(record_, separator::none.str);
+            binlog::put_u8(record_, static_cast<uint8_t>(binlog::arg_kind::text));
+            binlog::put_bytes(record_, name);
+            binlog::put_separator(record_, "=");
+            append_binary(value);
+            binlog::put_separator(record_, "] ");
+        }
+        if (json_) {
+            if (record_.back() != '{') {
+                record_.push_back(',');
+            }
+            record_.push_back('"');
+            append_json_escaped(record_, name);
+            record_.append("\":");
+            append_json(value);
+        }
+        sep_ = separator::space;
+    }
+
+    // Numbers and bools are written as JSON literals, strings and other streamable types as JSON strings.
+    template <typename T>
+    void append_json(const T& value)
+    {
+        if constexpr (std::same_as<T, bool>) {
+            record_.append(value ? "true" : "false");
+        }
+        else if constexpr (std::integral<T> && !is_char_type<T>) {
+            char digits[24] = {};
+            auto result = std::to_chars(std::begin(digits), std::end(digits), value);
+            record_.append(digits, result.ptr);
+        }
+        else if constexpr (std::same_as<T, float> || std::same_as<T, double>) {
+            char digits[32] = {};
+            auto result = std::to_chars(std::begin(digits), std::end(digits), value);
+            if (std::isfinite(value)) {
+                record_.append(digits, result.ptr);
+            }
+            else {
+                record_.push_back('"');
+                record_.append(digits, result.ptr);
+                record_.push_back('"');
+            }
+        }
+        else if constexpr (!string_convertible<T>) {
+            record_.append(json::serialize(value, string_converter_).dumps());
+        }
+        else if constexpr (std::is_constructible_v<json::value, T> && !has_output_operator<T>) {
+            record_.append(json::value(value).to_string());
+        }
+        else {
+            std::string text = LogBufferPool::acquire();
+            append_text(text, value);
+            record_.push_back('"');
+            append_json_escaped(record_, text);
+            record_.push_back('"');
+            LogBufferPool::release(std::move(text));
+        }
+    }
+
+    template <typename T>
+    void append_text(std::string& out, const T& value) const
     {
         if constexpr (string_convertible<T>) {
-            buffer_ << string_converter_(std::forward<T>(value)) << sep.str;
+            string_converter_.append(out, value);
         }
         else {
-            buffer_ << json::serialize(std::forward<T>(value), string_converter_).dumps() << sep.str;
+            out.append(json::serialize(value, string_converter_).dumps());
         }
     }
 
+    // Numbers and strings are stored raw, the decoder formats them. Anything else is converted to text here.
+    template <typename T>
+    void append_binary(const T& value)
+    {
+        using binlog::arg_kind;
+
+        if constexpr (std::same_as<T, bool>) {
+            binlog::put_u8(record_, static_cast<uint8_t>(arg_kind::boolean));
+            binlog::put_u8(record_, value ? 1 : 0);
+        }
+        else if constexpr (std::integral<T> && !is_char_type<T>) {
+            if constexpr (std::is_signed_v<T>) {
+                binlog::put_u8(record_, static_cast<uint8_t>(arg_kind::sint));
+                binlog::put_zigzag(record_, static_cast<int64_t>(value));
+            }
+            else {
+                binlog::put_u8(record_, static_cast<uint8_t>(arg_kind::uint));
+                binlog::put_varint(record_, static_cast<uint64_t>(value));
+            }
+        }
+        else if constexpr (std::same_as<T, float> || std::same_as<T, double>) {
+            binlog::put_u8(record_, static_cast<uint8_t>(arg_kind::real));
+            binlog::put_f64(record_, static_cast<double>(value));
+        }
+        else if constexpr (std::same_as<T, std::string> || std::same_as<T, std::string_view>
+                           || (std::is_array_v<T> && std::same_as<std::remove_cv_t<std::remove_extent_t<T>>, char>)) {
+            binlog::put_u8(record_, static_cast<uint8_t>(arg_kind::text));
+            binlog::put_bytes(record_, std::string_view(value));
+        }
+        else if constexpr (std::same_as<std::decay_t<T>, const char*> || std::same_as<std::decay_t<T>, char*>) {
+            binlog::put_u8(record_, static_cast<uint8_t>(arg_kind::text));
+            binlog::put_bytes(record_, value ? std::string_view(value) : std::string_view());
+        }
+        else {
+            std::string text = LogBufferPool::acquire();
+            append_text(text, value);
+            binlog::put_u8(record_, static_cast<uint8_t>(arg_kind::text));
+            binlog::put_bytes(record_, text);
+            LogBufferPool::release(std::move(text));
+        }
+    }
+
+    template <typename T>
+    static constexpr bool is_char_type = std::same_as<T, char> || std::same_as<T, signed char> || std::same_as<T, unsigned char>
+                                         || std::same_as<T, wchar_t> || std::same_as<T, char8_t> || std::same_as<T, char16_t>
+                                         || std::same_as<T, char32_t>;
+
     template <typename... args_t>
     void stream_props(args_t&&... args)
     {
@@ -187,25 +535,47 @@ private:
 #endif
         auto tid = static_cast<uint16_t>(std::hash<std::thread::id> {}(std::this_thread::get_id()));
 
-        std::string props = std::format("[{}][{}][Px{}][Tx{}]", format_now(), level_str(), pid, tid);
-        for (auto&& arg : { args... }) {
-            props += std::format("[{}]", arg);
+        if (text_) {
+            std::format_to(std::back_inserter(buffer_), "[{}][{}][Px{}][Tx{}]", format_now_view(), level_str(), pid, tid);
+            for (auto&& arg : { args... }) {
+                buffer_.push_back('[');
+                buffer_.append(arg);
+                buffer_.push_back(']');
+            }
+            buffer_.append(sep_.str);
+        }
+        if (binary_ || json_) {
+            const std::array<std::string_view, sizeof...(args)> props { std::string_view(args)... };
+            if (binary_) {
+                begin_binary(props, pid, tid);
+            }
+            else {
+                begin_json(props, pid, tid);
+            }
         }
-        stream(props, sep_);
     }
 
-    std::string stdout_string();
     std::string_view level_str();
+    void begin_binary(std::span<const std::string_view> props, int pid, uint16_t tid);
+    void begin_json(std::span<const std::string_view> props, int pid, uint16_t tid);
+    void finish_json();
 
 private:
-    std::mutex& mutex_;
-    std::ofstream& stream_;
+    Logger& logger_;
     const level lv_ = level::fatal;
     const bool stdout_ = false;
-    const StringConverter string_converter_;
+    const bool file_ = false;
+    // the file gets record_, a binlog entry or a JSON line, instead of the text line
+    const bool binary_ = false;
+    const bool json_ = false;
+    const bool text_ = false;
+    const StringConverter string_converter_ {};
 
     separator sep_ = separator::space;
-    std::stringstream buffer_;
+    std::string buffer_ = LogBufferPool::acquire();
+    std::string record_;
+    // escaped "message" of the JSON line, record_ collects the other fields
+    std::string message_;
 };
 
 MAA_LOG_NS_END
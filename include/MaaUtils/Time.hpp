@@ -9,8 +9,10 @@
 #endif
 
 #include <chrono>
+#include <cstdint>
 #include <format>
 #include <string>
+#include <string_view>
 
 #include "MaaUtils/Conf.h"
 
@@ -18,31 +20,151 @@
 
 MAA_NS_BEGIN
 
+namespace time_detail
+{
+inline void put_digits(char* dst, unsigned value, int width)
+{
+    for (int i = width - 1; i >= 0; --i) {
+        dst[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+// "YYYY-MM-DD HH:MM:SS.mmm"
+struct TimestampCache
+{
+    static constexpr size_t kLength = 23;
+
+    uint64_t second_key = ~0ULL;
+    char text[kLength + 1] = {};
+
+    void format_second(unsigned year, unsigned mon, unsigned day, unsigned hour, unsigned min, unsigned sec)
+    {
+        put_digits(text, year, 4);
+        text[4] = '-';
+        put_digits(text + 5, mon, 2);
+        text[7] = '-';
+        put_digits(text + 8, day, 2);
+        text[10] = ' ';
+        put_digits(text + 11, hour, 2);
+        text[13] = ':';
+        put_digits(text + 14, min, 2);
+        text[16] = ':';
+        put_digits(text + 17, sec, 2);
+        text[19] = '.';
+    }
+
+    std::string_view patch_millis(unsigned millis)
+    {
+        put_digits(text + 20, millis, 3);
+        return std::string_view(text, kLength);
+    }
+};
+}
+
+// Same text as format_now(), valid until the next call on this thread.
+// The date and time are only reformatted when the second changes, define MAA_TIME_COARSE_CLOCK
+// to read CLOCK_REALTIME_COARSE where available (a few ms of resolution, no syscall).
+inline std::string_view format_now_view()
+{
+    thread_local time_detail::TimestampCache cache;
+
+#ifdef _WIN32
+    SYSTEMTIME sys {};
+    GetLocalTime(&sys);
+
+    uint64_t key = ((((static_cast<uint64_t>(sys.wYear) * 13 + sys.wMonth) * 32 + sys.wDay) * 24 + sys.wHour) * 60 + sys.wMinute) * 60
+                   + sys.wSecond;
+    if (key != cache.second_key) {
+        cache.second_key = key;
+        cache.format_second(sys.wYear, sys.wMonth, sys.wDay, sys.wHour, sys.wMinute, sys.wSecond);
+    }
+    return cache.patch_millis(sys.wMilliseconds);
+#else
+    timespec ts = {};
+#if defined(MAA_TIME_COARSE_CLOCK) && defined(CLOCK_REALTIME_COARSE)
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+    auto key = static_cast<uint64_t>(ts.tv_sec);
+    if (key != cache.second_key) {
+        cache.second_key = key;
+        tm tm_info = {};
+        localtime_r(&ts.tv_sec, &tm_info);
+        cache.format_second(
+            tm_info.tm_year + 1900,
+            tm_info.tm_mon + 1,
+            tm_info.tm_mday,
+            tm_info.tm_hour,
+            tm_info.tm_min,
+            tm_info.tm_sec);
+    }
+    return cache.patch_millis(static_cast<unsigned>(ts.tv_nsec / 1'000'000));
+#endif
+}
+
 inline std::string format_now()
 {
-    constexpr std::string_view kFormat = "{:0>4}-{:0>2}-{:0>2} {:0>2}:{:0>2}:{:0>2}.{:0>3}";
+    return std::string(format_now_view());
+}
 
+// Milliseconds since 1970-01-01 00:00:00 of the local wall clock, i.e. the time format_now() prints.
+inline int64_t local_now_millis()
+{
 #ifdef _WIN32
     SYSTEMTIME sys {};
     GetLocalTime(&sys);
-    return std::format(kFormat, sys.wYear, sys.wMonth, sys.wDay, sys.wHour, sys.wMinute, sys.wSecond, sys.wMilliseconds);
+    FILETIME ft {};
+    SystemTimeToFileTime(&sys, &ft);
+
+    constexpr int64_t kEpochDiff = 116444736000000000LL; // 1601-01-01 to 1970-01-01 in 100ns
+    int64_t ticks = (static_cast<int64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    return (ticks - kEpochDiff) / 10'000;
 #else
-    timeval tv = {};
-    gettimeofday(&tv, nullptr);
-    time_t nowtime = tv.tv_sec;
-    tm* tm_info = localtime(&nowtime);
-    return std::format(
-        kFormat,
-        tm_info->tm_year + 1900,
-        tm_info->tm_mon + 1,
-        tm_info->tm_mday,
-        tm_info->tm_hour,
-        tm_info->tm_min,
-        tm_info->tm_sec,
-        tv.tv_usec / 1000);
+    // the utc offset is refreshed once per second, like the text in format_now_view()
+    thread_local time_t cached_sec = -1;
+    thread_local long cached_offset = 0;
+
+    timespec ts = {};
+#if defined(MAA_TIME_COARSE_CLOCK) && defined(CLOCK_REALTIME_COARSE)
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+    if (ts.tv_sec != cached_sec) {
+        cached_sec = ts.tv_sec;
+        tm tm_info = {};
+        localtime_r(&ts.tv_sec, &tm_info);
+        cached_offset = tm_info.tm_gmtoff;
+    }
+    return (static_cast<int64_t>(ts.tv_sec) + cached_offset) * 1000 + ts.tv_nsec / 1'000'000;
 #endif
 }
 
+// Renders local_now_millis() the way format_now() does, independent of the current time zone.
+inline std::string format_local_millis(int64_t millis)
+{
+    using namespace std::chrono;
+
+    sys_time<milliseconds> tp { milliseconds(millis) };
+    auto day = floor<days>(tp);
+    year_month_day ymd { day };
+    hh_mm_ss hms { floor<milliseconds>(tp - day) };
+
+    time_detail::TimestampCache text;
+    text.format_second(
+        static_cast<unsigned>(static_cast<int>(ymd.year())),
+        static_cast<unsigned>(ymd.month()),
+        static_cast<unsigned>(ymd.day()),
+        static_cast<unsigned>(hms.hours().count()),
+        static_cast<unsigned>(hms.minutes().count()),
+        static_cast<unsigned>(hms.seconds().count()));
+    return std::string(text.patch_millis(static_cast<unsigned>(hms.subseconds().count())));
+}
+
 inline std::string format_now_for_filename()
 {
     constexpr std::string_view kFormat = "{:0>4}.{:0>2}.{:0>2}-{:0>2}.{:0>2}.{:0>2}.{}";
@@ -55,15 +177,16 @@ inline std::string format_now_for_filename()
     timeval tv = {};
     gettimeofday(&tv, nullptr);
     time_t nowtime = tv.tv_sec;
-    tm* tm_info = localtime(&nowtime);
+    tm tm_info = {};
+    localtime_r(&nowtime, &tm_info);
     return std::format(
         kFormat,
-        tm_info->tm_year + 1900,
-        tm_info->tm_mon + 1,
-        tm_info->tm_mday,
-        tm_info->tm_hour,
-        tm_info->tm_min,
-        tm_info->tm_sec,
+        tm_info.tm_year + 1900,
+        tm_info.tm_mon + 1,
+        tm_info.tm_mday,
+        tm_info.tm_hour,
+        tm_info.tm_min,
+        tm_info.tm_sec,
         tv.tv_usec / 1000);
 #endif
 }
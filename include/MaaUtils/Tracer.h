@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <string_view>
+
+#include "MaaUtils/Conf.h"
+#include "MaaUtils/NonCopyable.hpp"
+#include "MaaUtils/Port.h"
+
+MAA_LOG_NS_BEGIN
+
+// Records begin / end events of MAA_TRACE_SCOPE and LogFunc scopes into per-thread buffers.
+// dump() writes them in the Chrome trace-event format, open it in chrome://tracing or ui.perfetto.dev.
+// While stopped, a scope costs one relaxed atomic load.
+class MAA_UTILS_API Tracer
+{
+public:
+    static constexpr size_t kDefaultMaxEvents = 1024 * 1024;
+
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // events beyond the per-thread limit are dropped, recorded events are kept until reset()
+    static void start(size_t max_events_per_thread = kDefaultMaxEvents);
+    static void stop();
+    // Discards every recorded event. A running thread frees its buffer on its next event.
+    static void reset();
+
+    // `name` is stored as a view, it must live until dump(), e.g. a string literal or MAA_FUNCTION
+    static void begin(std::string_view name);
+    static void end(std::string_view name);
+
+    static bool dump(const std::filesystem::path& path);
+
+private:
+    static std::atomic_bool enabled_;
+};
+
+class TraceScope : public NonCopyable
+{
+public:
+    explicit TraceScope(std::string_view name)
+        : name_(name)
+    {
+        if (active_) {
+            Tracer::begin(name_);
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (active_) {
+            Tracer::end(name_);
+        }
+    }
+
+private:
+    const std::string_view name_;
+    // an end event is recorded for every begin, even if the tracer stops in between
+    const bool active_ = Tracer::enabled();
+};
+
+MAA_LOG_NS_END
+
+#define MAA_TRACE_CONCAT2(a, b) a##b
+#define MAA_TRACE_CONCAT(a, b) MAA_TRACE_CONCAT2(a, b)
+#define MAA_TRACE_SCOPE(name) MAA_LOG_NS::TraceScope MAA_TRACE_CONCAT(maa_trace_scope_, __LINE__)(name)
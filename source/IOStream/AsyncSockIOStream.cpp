@@ -0,0 +1,282 @@
+#include "MaaUtils/IOStream/AsyncSockIOStream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "MaaUtils/Logger.h"
+
+MAA_NS_BEGIN
+
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+
+namespace
+{
+// Cancels the read bound to token() when `timeout` passes before the scope ends.
+// Only that read, a write pending on the same socket goes on.
+class ReadDeadline : public NonCopyable
+{
+public:
+    // `generation` tells a handler that was already queued when its read finished from the current deadline
+    ReadDeadline(boost::asio::steady_timer& timer, uint64_t& generation, std::chrono::milliseconds timeout)
+        : timer_(timer)
+        , generation_(generation)
+    {
+        if (timeout == std::chrono::milliseconds::max()) {
+            return;
+        }
+
+        armed_ = true;
+        timer_.expires_after(timeout);
+        timer_.async_wait([this, &generation, mine = ++generation](const boost::system::error_code& ec) {
+            // a stale handler would outlive this deadline
+            if (ec || generation != mine) {
+                return;
+            }
+            expired_ = true;
+            // partial: the read reports what it got so far and the socket stays usable
+            signal_.emit(boost::asio::cancellation_type::partial);
+        });
+    }
+
+    ~ReadDeadline()
+    {
+        if (armed_) {
+            ++generation_;
+            timer_.cancel();
+        }
+    }
+
+    // also true if it passed between two reads, when there was nothing to cancel
+    bool expired() const { return expired_; }
+
+    auto token(boost::system::error_code& ec)
+    {
+        return boost::asio::bind_cancellation_slot(
+            armed_ ? signal_.slot() : boost::asio::cancellation_slot(),
+            redirect_error(use_awaitable, ec));
+    }
+
+private:
+    boost::asio::steady_timer& timer_;
+    uint64_t& generation_;
+    boost::asio::cancellation_signal signal_;
+    bool armed_ = false;
+    bool expired_ = false;
+};
+}
+
+AsyncServerSockIOFactory::AsyncServerSockIOFactory(boost::asio::io_context& io_ctx, const std::string& address, uint16_t port)
+    : server_acceptor_(io_ctx)
+{
+    LogFunc << VAR(address) << VAR(port);
+
+    using namespace boost::asio::ip;
+
+    tcp::endpoint endpoint(address::from_string(address), port);
+
+    server_acceptor_.open(endpoint.protocol());
+    server_acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    server_acceptor_.bind(endpoint);
+
+    server_acceptor_.listen();
+}
+
+AsyncServerSockIOFactory::~AsyncServerSockIOFactory()
+{
+    LogFunc;
+
+    boost::system::error_code ec;
+    server_acceptor_.close(ec);
+}
+
+uint16_t AsyncServerSockIOFactory::port() const
+{
+    return server_acceptor_.local_endpoint().port();
+}
+
+boost::asio::awaitable<std::shared_ptr<AsyncSockIOStream>> AsyncServerSockIOFactory::accept()
+{
+    boost::system::error_code ec;
+    auto socket = co_await server_acceptor_.async_accept(redirect_error(use_awaitable, ec));
+    if (ec) {
+        LogError << "accept failed" << VAR(ec.message());
+        co_return nullptr;
+    }
+
+    co_return std::make_shared<AsyncSockIOStream>(std::move(socket));
+}
+
+AsyncClientSockIOFactory::AsyncClientSockIOFactory(boost::asio::io_context& io_ctx, const std::string& address, unsigned short port)
+    : executor_(io_ctx.get_executor())
+    , endpoint_(boost::asio::ip::address::from_string(address), port)
+{
+    LogFunc << VAR(address) << VAR(port);
+}
+
+boost::asio::awaitable<std::shared_ptr<AsyncSockIOStream>> AsyncClientSockIOFactory::connect()
+{
+    LogFunc;
+
+    boost::asio::ip::tcp::socket socket(executor_);
+    boost::system::error_code ec;
+    co_await socket.async_connect(endpoint_, redirect_error(use_awaitable, ec));
+    if (ec) {
+        LogError << "connect failed" << VAR(ec.message());
+        co_return nullptr;
+    }
+
+    co_return std::make_shared<AsyncSockIOStream>(std::move(socket));
+}
+
+AsyncSockIOStream::AsyncSockIOStream(boost::asio::ip::tcp::socket&& socket)
+    : socket_(std::move(socket))
+    , read_deadline_(socket_.get_executor())
+{
+}
+
+AsyncSockIOStream::~AsyncSockIOStream()
+{
+    release();
+}
+
+AsyncSockIOStream::awaitable<std::string> AsyncSockIOStream::read_some(size_t count, duration_t timeout)
+{
+    constexpr size_t kChunkSize = 128 * 1024;
+
+    std::string result = take_read_buffer(count);
+
+    ReadDeadline deadline(read_deadline_, deadline_generation_, timeout);
+    while (is_open() && result.size() < count && !deadline.expired()) {
+        size_t size = result.size();
+        size_t chunk = std::min(count - size, kChunkSize);
+        result.resize(size + chunk);
+
+        boost::system::error_code ec;
+        size_t read = co_await boost::asio::async_read(socket_, boost::asio::buffer(result.data() + size, chunk), deadline.token(ec));
+        result.resize(size + read);
+
+        if (ec) {
+            on_read_error(ec);
+            break;
+        }
+    }
+
+    co_return result;
+}
+
+AsyncSockIOStream::awaitable<std::string> AsyncSockIOStream::read_until(std::string_view delimiter, duration_t timeout)
+{
+    if (delimiter.empty()) {
+        co_return std::string();
+    }
+
+    if (size_t pos = read_buffer_.find(delimiter); pos != std::string::npos) {
+        co_return take_read_buffer(pos + delimiter.size());
+    }
+    if (!is_open()) {
+        co_return std::exchange(read_buffer_, {});
+    }
+
+    ReadDeadline deadline(read_deadline_, deadline_generation_, timeout);
+    boost::system::error_code ec;
+    size_t size = co_await boost::asio::async_read_until(socket_, boost::asio::dynamic_buffer(read_buffer_), delimiter, deadline.token(ec));
+
+    if (ec) {
+        // whatever arrived before the timeout or the end, as IOStream::read_until()
+        on_read_error(ec);
+        co_return std::exchange(read_buffer_, {});
+    }
+    co_return take_read_buffer(size);
+}
+
+AsyncSockIOStream::awaitable<bool> AsyncSockIOStream::read_exact(std::span<char> buffer, duration_t timeout)
+{
+    size_t done = std::min(buffer.size(), read_buffer_.size());
+    std::memcpy(buffer.data(), read_buffer_.data(), done);
+    read_buffer_.erase(0, done);
+
+    if (done < buffer.size() && is_open()) {
+        ReadDeadline deadline(read_deadline_, deadline_generation_, timeout);
+        boost::system::error_code ec;
+        done += co_await boost::asio::async_read(
+            socket_,
+            boost::asio::buffer(buffer.data() + done, buffer.size() - done),
+            deadline.token(ec));
+        if (ec) {
+            on_read_error(ec);
+        }
+    }
+
+    if (done < buffer.size()) {
+        // put the partial data back, a retry starts from the same byte
+        read_buffer_.insert(0, buffer.data(), done);
+        co_return false;
+    }
+    co_return true;
+}
+
+AsyncSockIOStream::awaitable<bool> AsyncSockIOStream::write(std::string_view data)
+{
+    co_return co_await write_batch(std::span<const std::string_view>(&data, 1), true);
+}
+
+AsyncSockIOStream::awaitable<bool> AsyncSockIOStream::write_batch(std::span<const std::string_view> messages, bool newline)
+{
+    static constexpr char kNewline = '\n';
+
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.reserve(messages.size() * (newline ? 2 : 1));
+    for (const auto& msg : messages) {
+        buffers.emplace_back(msg.data(), msg.size());
+        if (newline) {
+            buffers.emplace_back(&kNewline, 1);
+        }
+    }
+
+    boost::system::error_code ec;
+    co_await boost::asio::async_write(socket_, buffers, redirect_error(use_awaitable, ec));
+    if (ec) {
+        LogError << "write failed" << VAR(ec.message());
+        co_return false;
+    }
+    co_return true;
+}
+
+bool AsyncSockIOStream::release()
+{
+    boost::system::error_code ec;
+    socket_.close(ec);
+    return true;
+}
+
+bool AsyncSockIOStream::is_open() const
+{
+    return socket_.is_open() && !eof_;
+}
+
+std::string AsyncSockIOStream::take_read_buffer(size_t count)
+{
+    if (count >= read_buffer_.size()) {
+        return std::exchange(read_buffer_, {});
+    }
+
+    std::string result = read_buffer_.substr(0, count);
+    read_buffer_.erase(0, count);
+    return result;
+}
+
+void AsyncSockIOStream::on_read_error(const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted) {
+        // timed out, the stream stays usable
+        return;
+    }
+    if (ec != boost::asio::error::eof) {
+        LogError << "read failed" << VAR(ec.message());
+    }
+    eof_ = true;
+}
+
+MAA_NS_END
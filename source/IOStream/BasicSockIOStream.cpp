@@ -0,0 +1,317 @@
+#include "MaaUtils/IOStream/BasicSockIOStream.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "MaaUtils/IOStream/LocalSockIOStream.h"
+#include "MaaUtils/IOStream/SockIOStream.h"
+#include "MaaUtils/Logger.h"
+#include "PollReadable.h"
+#include "WriteVectored.h"
+
+MAA_NS_BEGIN
+
+template <typename Stream>
+BasicServerSockIOFactory<Stream>::BasicServerSockIOFactory(const options_type& options)
+    : options_(options)
+    , server_acceptor_(io_ctx_)
+{
+}
+
+template <typename Stream>
+BasicServerSockIOFactory<Stream>::~BasicServerSockIOFactory()
+{
+    LogFunc;
+
+    server_acceptor_.close();
+}
+
+template <typename Stream>
+void BasicServerSockIOFactory<Stream>::set_preaccept_backlog(size_t count)
+{
+    preaccept_backlog_ = count;
+    while (preaccepted_.size() > preaccept_backlog_) {
+        preaccepted_.pop_back();
+    }
+}
+
+template <typename Stream>
+std::shared_ptr<Stream> BasicServerSockIOFactory<Stream>::accept(duration_t timeout)
+{
+    // LogFunc;
+
+    if (!preaccepted_.empty()) {
+        auto stream = std::move(preaccepted_.front());
+        preaccepted_.pop_front();
+        return stream;
+    }
+
+    // runs on io_ctx_ in this thread, the deadline is io_context::run_for()
+    typename protocol_type::iostream ios;
+    boost::system::error_code ec = boost::asio::error::would_block;
+    server_acceptor_.async_accept(ios.socket(), [&](const boost::system::error_code& error) { ec = error; });
+
+    io_ctx_.restart();
+    if (timeout == duration_t::max()) {
+        io_ctx_.run();
+    }
+    else {
+        io_ctx_.run_for(timeout);
+    }
+
+    if (ec == boost::asio::error::would_block) {
+        server_acceptor_.cancel();
+        // completes the cancelled handler, which still refers to this frame
+        io_ctx_.restart();
+        io_ctx_.run();
+    }
+    // the accept may have completed between the deadline and cancel(), that connection is kept
+    if (ec == boost::asio::error::operation_aborted) {
+        LogError << "accept timeout" << VAR(timeout);
+        return nullptr;
+    }
+    if (ec) {
+        LogError << "accept failed" << VAR(ec.message());
+        return nullptr;
+    }
+
+    if (ios.eof()) {
+        LogError << "socket is not opened";
+        return nullptr;
+    }
+
+    auto stream = std::make_shared<Stream>(std::move(ios), options_);
+    preaccept();
+    return stream;
+}
+
+template <typename Stream>
+void BasicServerSockIOFactory<Stream>::preaccept()
+{
+    if (preaccepted_.size() >= preaccept_backlog_) {
+        return;
+    }
+
+    boost::system::error_code ec;
+    server_acceptor_.non_blocking(true, ec);
+    while (!ec && preaccepted_.size() < preaccept_backlog_) {
+        typename protocol_type::iostream ios;
+        server_acceptor_.accept(ios.socket(), ec);
+        if (!ec) {
+            preaccepted_.emplace_back(std::make_shared<Stream>(std::move(ios), options_));
+        }
+    }
+    server_acceptor_.non_blocking(false, ec);
+}
+
+template <typename Stream>
+BasicClientSockIOFactory<Stream>::BasicClientSockIOFactory(const typename protocol_type::endpoint& endpoint, const options_type& options)
+    : options_(options)
+    , endpoint_(endpoint)
+{
+}
+
+template <typename Stream>
+std::shared_ptr<Stream> BasicClientSockIOFactory<Stream>::connect()
+{
+    LogFunc;
+
+    using iostream = typename protocol_type::iostream;
+
+    iostream ios;
+    if (options_.connect_timeout != IOStream::duration_t::max()) {
+        ios.expires_after(options_.connect_timeout);
+    }
+    ios.connect(endpoint_);
+    if (!ios) {
+        LogError << "failed to connect" << VAR(ios.error().message());
+        return nullptr;
+    }
+    // the deadline would otherwise apply to all later reads and writes
+    ios.expires_at(iostream::time_point::max());
+
+    return std::make_shared<Stream>(std::move(ios), options_);
+}
+
+template <typename Protocol>
+BasicSockIOStream<Protocol>::BasicSockIOStream(iostream_type&& ios)
+    : ios_(std::move(ios))
+{
+}
+
+template <typename Protocol>
+BasicSockIOStream<Protocol>::~BasicSockIOStream()
+{
+    release();
+}
+
+template <typename Protocol>
+bool BasicSockIOStream<Protocol>::write_buffered(std::string_view data, bool newline)
+{
+    if (!ios_.good()) {
+        LogError << "ios is not good";
+        return false;
+    }
+
+    ios_ << data;
+    if (newline) {
+        ios_ << '\n';
+    }
+    return ios_.good();
+}
+
+template <typename Protocol>
+bool BasicSockIOStream<Protocol>::write_batch(std::span<const std::string_view> messages, bool newline)
+{
+#ifdef _WIN32
+    return IOStream::write_batch(messages, newline);
+#else
+    // the buffered bytes go first, then the batch bypasses the stream buffer in one sendmsg
+    if (!flush()) {
+        return false;
+    }
+    // bounded by expires_after() like the stream's own reads and writes
+    auto timeout = duration_t::max();
+    if (auto expiry = ios_.expiry(); expiry != iostream_type::time_point::max()) {
+        auto remaining = std::chrono::duration_cast<duration_t>(expiry - iostream_type::clock_type::now());
+        timeout = std::max(remaining, duration_t::zero());
+    }
+    if (!send_vectored(ios_.socket().native_handle(), messages, newline, timeout)) {
+        LogError << "sendmsg failed" << VAR(errno);
+        return false;
+    }
+    return true;
+#endif
+}
+
+template <typename Protocol>
+bool BasicSockIOStream<Protocol>::flush()
+{
+    if (!ios_.good()) {
+        LogError << "ios is not good";
+        return false;
+    }
+
+    ios_.flush();
+    return ios_.good();
+}
+
+template <typename Protocol>
+bool BasicSockIOStream<Protocol>::release()
+{
+    ios_.close();
+    return true;
+}
+
+template <typename Protocol>
+void BasicSockIOStream<Protocol>::shutdown_read()
+{
+    // a blocked recv returns 0, unlike with close()
+    boost::system::error_code ec;
+    ios_.socket().shutdown(boost::asio::socket_base::shutdown_receive, ec);
+}
+
+template <typename Protocol>
+bool BasicSockIOStream<Protocol>::is_open() const
+{
+    return ios_.rdbuf()->socket().is_open() && !ios_.eof();
+}
+
+template <typename Protocol>
+void BasicSockIOStream<Protocol>::expires_after(duration_t timeout)
+{
+    ios_.expires_after(timeout);
+}
+
+template <typename Protocol>
+bool BasicSockIOStream<Protocol>::probe_idle()
+{
+    // bytes left in either buffer belong to the last exchange, the next one would read them
+    if (!is_open() || has_buffered_input() || ios_.rdbuf()->in_avail() > 0) {
+        return false;
+    }
+
+#ifdef _WIN32
+    boost::system::error_code ec;
+    return ios_.socket().available(ec) == 0 && !ec;
+#else
+    // an idle connection only turns readable with stray data, eof or an error
+    return !poll_readable(ios_.socket().native_handle(), duration_t::zero());
+#endif
+}
+
+template <typename Protocol>
+std::string BasicSockIOStream<Protocol>::read_once(size_t max_count)
+{
+    constexpr size_t kBufferSize = 128 * 1024;
+
+    if (!buffer_) {
+        buffer_ = std::make_unique<char[]>(kBufferSize);
+    }
+
+    size_t count = std::min(kBufferSize, max_count);
+    auto read = ios_.read(buffer_.get(), count).gcount();
+    after_read();
+    return std::string(buffer_.get(), read);
+}
+
+template <typename Protocol>
+size_t BasicSockIOStream<Protocol>::read_once_into(std::span<char> buffer)
+{
+    auto read = ios_.read(buffer.data(), static_cast<std::streamsize>(buffer.size())).gcount();
+    after_read();
+    return static_cast<size_t>(read);
+}
+
+template <typename Protocol>
+size_t BasicSockIOStream<Protocol>::read_available(char* buffer, size_t max_count)
+{
+    if (max_count == 0) {
+        return 0;
+    }
+
+    // the first byte refills the stream buffer, the rest is taken from it without blocking
+    auto read = ios_.read(buffer, 1).gcount();
+    if (read == 0) {
+        return 0;
+    }
+    read += ios_.readsome(buffer + 1, static_cast<std::streamsize>(max_count - 1));
+    after_read();
+    return static_cast<size_t>(read);
+}
+
+template <typename Protocol>
+bool BasicSockIOStream<Protocol>::wait_readable(duration_t timeout)
+{
+    // bytes already in the stream buffer are readable without touching the fd
+    if (ios_.rdbuf()->in_avail() > 0) {
+        return true;
+    }
+
+#ifdef _WIN32
+    int wait_ms = -1;
+    if (timeout != duration_t::max()) {
+        wait_ms = static_cast<int>(std::clamp<duration_t::rep>(timeout.count(), 0, std::numeric_limits<int>::max()));
+    }
+
+    WSAPOLLFD pfd {};
+    pfd.fd = ios_.socket().native_handle();
+    pfd.events = POLLRDNORM;
+    // an error is left to the read to report, as poll_readable() does
+    return ::WSAPoll(&pfd, 1, wait_ms) != 0;
+#else
+    return poll_readable(ios_.socket().native_handle(), timeout);
+#endif
+}
+
+template class BasicSockIOStream<boost::asio::ip::tcp>;
+template class BasicServerSockIOFactory<SockIOStream>;
+template class BasicClientSockIOFactory<SockIOStream>;
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+template class BasicSockIOStream<boost::asio::local::stream_protocol>;
+template class BasicServerSockIOFactory<LocalSockIOStream>;
+template class BasicClientSockIOFactory<LocalSockIOStream>;
+#endif
+
+MAA_NS_END
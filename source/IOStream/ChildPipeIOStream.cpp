@@ -1,7 +1,15 @@
+#ifndef __linux__
+
 #include "MaaUtils/IOStream/ChildPipeIOStream.h"
 
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
 #include "MaaUtils/Encoding.h"
 #include "MaaUtils/Logger.h"
+#include "PollReadable.h"
+#include "WriteVectored.h"
 
 MAA_NS_BEGIN
 
@@ -52,21 +60,33 @@ std::vector<std::string> conv_args(const std::vector<std::string>& args)
 }
 #endif
 
-ChildPipeIOStream::ChildPipeIOStream(const std::filesystem::path& exec, const std::vector<std::string>& args)
-    : ChildPipeIOStream(exec, conv_args(args), false)
+ChildPipeIOStream::ChildPipeIOStream(
+    const std::filesystem::path& exec,
+    const std::vector<std::string>& args,
+    const ChildPipeOptions& options)
+    : ChildPipeIOStream(exec, conv_args(args), options, false)
 {
 }
 
 #ifdef _WIN32
-ChildPipeIOStream::ChildPipeIOStream(const std::filesystem::path& exec, const std::vector<std::wstring>& wargs)
-    : ChildPipeIOStream(exec, wargs, false)
+ChildPipeIOStream::ChildPipeIOStream(
+    const std::filesystem::path& exec,
+    const std::vector<std::wstring>& wargs,
+    const ChildPipeOptions& options)
+    : ChildPipeIOStream(exec, wargs, options, false)
 {
 }
 #endif
 
-ChildPipeIOStream::ChildPipeIOStream(const std::filesystem::path& exec, const std::vector<os_string>& args, bool)
+// only the release options apply to this backend
+ChildPipeIOStream::ChildPipeIOStream(
+    const std::filesystem::path& exec,
+    const std::vector<os_string>& args,
+    const ChildPipeOptions& options,
+    bool)
     : exec_(exec)
     , args_(args)
+    , options_(options)
     , child_(
           exec_,
           args_,
@@ -88,24 +108,65 @@ ChildPipeIOStream::~ChildPipeIOStream()
     release();
 }
 
-bool ChildPipeIOStream::write(std::string_view data)
+bool ChildPipeIOStream::write_buffered(std::string_view data, bool newline)
 {
     if (!pout_.good()) {
         LogError << "pout is not good" << VAR(exec_) << VAR(args_) << VAR(child_.id());
         return false;
     }
 
-    pout_ << data << std::endl;
+    pout_ << data;
+    if (newline) {
+        pout_ << '\n';
+    }
+    return pout_.good();
+}
+
+bool ChildPipeIOStream::write_batch(std::span<const std::string_view> messages, bool newline)
+{
+#ifdef _WIN32
+    return IOStream::write_batch(messages, newline);
+#else
+    // the buffered bytes go first, then the batch bypasses the stream buffer in one writev
+    if (!flush()) {
+        return false;
+    }
+    if (!write_vectored(pout_.pipe().native_sink(), messages, newline)) {
+        LogError << "writev failed" << VAR(errno);
+        return false;
+    }
     return true;
+#endif
+}
+
+bool ChildPipeIOStream::flush()
+{
+    if (!pout_.good()) {
+        LogError << "pout is not good" << VAR(exec_) << VAR(args_) << VAR(child_.id());
+        return false;
+    }
+
+    pout_.flush();
+    return pout_.good();
 }
 
 bool ChildPipeIOStream::release()
 {
-    auto start_time = std::chrono::steady_clock::now();
     using namespace std::chrono_literals;
-    while (child_.running() && duration_since(start_time) < 100ms) {
-        std::this_thread::yield();
+    auto wait_exit = [&]() {
+        auto start_time = std::chrono::steady_clock::now();
+        while (child_.running() && duration_since(start_time) < options_.graceful_period) {
+            std::this_thread::sleep_for(1ms);
+        }
+    };
+
+    wait_exit();
+#ifndef _WIN32
+    if (child_.running() && options_.terminate_first) {
+        ::kill(child_.id(), SIGTERM);
+        wait_exit();
     }
+#endif
 
     if (child_.running()) {
         child_.terminate();
@@ -124,6 +185,34 @@ bool ChildPipeIOStream::release()
     return true;
 }
 
+std::future<bool> ChildPipeIOStream::release_async()
+{
+    return std::async(std::launch::async, [this]() { return release(); });
+}
+
+bool ChildPipeIOStream::running()
+{
+    return child_.running();
+}
+
+std::string ChildPipeIOStream::read_stderr()
+{
+    return {};
+}
+
+bool ChildPipeIOStream::has_pending_output()
+{
+    if (has_buffered_input() || pin_.rdbuf()->in_avail() > 0) {
+        return true;
+    }
+
+#ifdef _WIN32
+    return false;
+#else
+    return is_open() && poll_readable(pin_.pipe().native_source(), duration_t::zero());
+#endif
+}
+
 bool ChildPipeIOStream::is_open() const
 {
     return !pin_.eof();
@@ -142,4 +231,41 @@ std::string ChildPipeIOStream::read_once(size_t max_count)
     return std::string(buffer_.get(), read);
 }
 
+size_t ChildPipeIOStream::read_once_into(std::span<char> buffer)
+{
+    return static_cast<size_t>(pin_.read(buffer.data(), static_cast<std::streamsize>(buffer.size())).gcount());
+}
+
+size_t ChildPipeIOStream::read_available(char* buffer, size_t max_count)
+{
+    if (max_count == 0) {
+        return 0;
+    }
+
+    // the first byte refills the stream buffer, the rest is taken from it without blocking
+    auto read = pin_.read(buffer, 1).gcount();
+    if (read == 0) {
+        return 0;
+    }
+    read += pin_.readsome(buffer + 1, static_cast<std::streamsize>(max_count - 1));
+    return static_cast<size_t>(read);
+}
+
+bool ChildPipeIOStream::wait_readable(duration_t timeout)
+{
+    // bytes already in the stream buffer are readable without touching the fd
+    if (pin_.rdbuf()->in_avail() > 0) {
+        return true;
+    }
+
+#ifdef _WIN32
+    std::ignore = timeout;
+    return true;
+#else
+    return poll_readable(pin_.pipe().native_source(), timeout);
+#endif
+}
+
 MAA_NS_END
+
+#endif
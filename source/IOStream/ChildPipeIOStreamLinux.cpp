@@ -0,0 +1,455 @@
+#ifdef __linux__
+
+#include "MaaUtils/IOStream/ChildPipeIOStream.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include "MaaUtils/Logger.h"
+#include "PollReadable.h"
+#include "WriteVectored.h"
+
+extern char** environ;
+
+MAA_NS_BEGIN
+
+static void close_fd(int& fd)
+{
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+ChildPipeIOStream::ChildPipeIOStream(
+    const std::filesystem::path& exec,
+    const std::vector<std::string>& args,
+    const ChildPipeOptions& options)
+    : ChildPipeIOStream(exec, args, options, false)
+{
+}
+
+ChildPipeIOStream::ChildPipeIOStream(
+    const std::filesystem::path& exec,
+    const std::vector<os_string>& args,
+    const ChildPipeOptions& options,
+    bool)
+    : exec_(exec)
+    , args_(args)
+    , options_(options)
+{
+    spawn();
+
+    LogDebug << VAR(exec_) << VAR(args_) << VAR(pid_);
+}
+
+ChildPipeIOStream::ChildPipeIOStream(ChildPipeIOStream&& other) noexcept
+    : IOStream(std::move(other))
+    , exec_(std::move(other.exec_))
+    , args_(std::move(other.args_))
+    , options_(other.options_)
+    , pid_(std::exchange(other.pid_, -1))
+    , in_fd_(std::exchange(other.in_fd_, -1))
+    , out_fd_(std::exchange(other.out_fd_, -1))
+    , err_fd_(std::exchange(other.err_fd_, -1))
+    , eof_(other.eof_)
+    , exit_code_(other.exit_code_)
+    , write_buffer_(std::move(other.write_buffer_))
+{
+}
+
+ChildPipeIOStream& ChildPipeIOStream::operator=(ChildPipeIOStream&& other) noexcept
+{
+    if (this == &other) {
+        return *this;
+    }
+
+    release();
+
+    IOStream::operator=(std::move(other));
+    exec_ = std::move(other.exec_);
+    args_ = std::move(other.args_);
+    options_ = other.options_;
+    pid_ = std::exchange(other.pid_, -1);
+    in_fd_ = std::exchange(other.in_fd_, -1);
+    out_fd_ = std::exchange(other.out_fd_, -1);
+    err_fd_ = std::exchange(other.err_fd_, -1);
+    eof_ = other.eof_;
+    exit_code_ = other.exit_code_;
+    write_buffer_ = std::move(other.write_buffer_);
+    return *this;
+}
+
+ChildPipeIOStream::~ChildPipeIOStream()
+{
+    release();
+}
+
+void ChildPipeIOStream::spawn()
+{
+    // [0] read end, [1] write end. All CLOEXEC, the child receives its ends through dup2, which clears the flag,
+    // and no other child started meanwhile inherits them.
+    int stdin_pipe[2] = { -1, -1 };
+    int stdout_pipe[2] = { -1, -1 };
+    int stderr_pipe[2] = { -1, -1 };
+
+    // copies of the extra fds above every target number, so that no dup2 overwrites the source of a later one
+    std::vector<int> extra_fds;
+
+    auto close_all = [&]() {
+        for (int* fds : { stdin_pipe, stdout_pipe, stderr_pipe }) {
+            close_fd(fds[0]);
+            close_fd(fds[1]);
+        }
+        for (int& fd : extra_fds) {
+            close_fd(fd);
+        }
+    };
+
+    if (::pipe2(stdin_pipe, O_CLOEXEC) != 0 || ::pipe2(stdout_pipe, O_CLOEXEC) != 0
+        || (options_.capture_stderr && ::pipe2(stderr_pipe, O_CLOEXEC) != 0)) {
+        LogError << "pipe2 failed" << VAR(errno);
+        close_all();
+        eof_ = true;
+        return;
+    }
+
+    constexpr int kFirstExtraFd = STDERR_FILENO + 1;
+    int min_copy_fd = kFirstExtraFd + static_cast<int>(options_.extra_fds.size());
+    for (int fd : options_.extra_fds) {
+        int copy = ::fcntl(fd, F_DUPFD_CLOEXEC, min_copy_fd);
+        if (copy < 0) {
+            LogError << "fcntl F_DUPFD_CLOEXEC failed" << VAR(errno) << VAR(fd);
+            close_all();
+            eof_ = true;
+            return;
+        }
+        extra_fds.emplace_back(copy);
+    }
+
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    ::posix_spawn_file_actions_adddup2(&actions, stdin_pipe[0], STDIN_FILENO);
+    ::posix_spawn_file_actions_adddup2(&actions, stdout_pipe[1], STDOUT_FILENO);
+    if (options_.capture_stderr) {
+        ::posix_spawn_file_actions_adddup2(&actions, stderr_pipe[1], STDERR_FILENO);
+    }
+    else {
+        ::posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    for (size_t i = 0; i < extra_fds.size(); ++i) {
+        ::posix_spawn_file_actions_adddup2(&actions, extra_fds[i], kFirstExtraFd + static_cast<int>(i));
+    }
+
+    // an empty signal mask and a default SIGPIPE, whatever the parent uses
+    posix_spawnattr_t attr;
+    ::posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    ::posix_spawnattr_setsigmask(&attr, &mask);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    ::posix_spawnattr_setsigdefault(&attr, &defaults);
+    ::posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    std::string exec_path = exec_.string();
+    std::vector<char*> argv;
+    argv.reserve(args_.size() + 2);
+    argv.emplace_back(exec_path.data());
+    for (auto& arg : args_) {
+        argv.emplace_back(arg.data());
+    }
+    argv.emplace_back(nullptr);
+
+    // glibc implements posix_spawn with clone(CLONE_VM | CLONE_VFORK), the address space is not copied
+    int ret = ::posix_spawn(&pid_, exec_path.c_str(), &actions, &attr, argv.data(), environ);
+
+    ::posix_spawnattr_destroy(&attr);
+    ::posix_spawn_file_actions_destroy(&actions);
+
+    if (ret != 0) {
+        LogError << "posix_spawn failed" << VAR(ret) << VAR(exec_) << VAR(args_);
+        pid_ = -1;
+        close_all();
+        eof_ = true;
+        return;
+    }
+
+    in_fd_ = std::exchange(stdout_pipe[0], -1);
+    out_fd_ = std::exchange(stdin_pipe[1], -1);
+    err_fd_ = std::exchange(stderr_pipe[0], -1);
+    close_all();
+
+    for (int fd : { in_fd_, out_fd_, err_fd_ }) {
+        if (fd >= 0) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+    }
+
+    if (options_.pipe_size > 0) {
+        for (int fd : { in_fd_, out_fd_ }) {
+            if (::fcntl(fd, F_SETPIPE_SZ, static_cast<int>(options_.pipe_size)) < 0) {
+                LogWarn << "F_SETPIPE_SZ failed" << VAR(errno) << VAR(options_.pipe_size);
+            }
+        }
+    }
+}
+
+void ChildPipeIOStream::close_fds()
+{
+    close_fd(in_fd_);
+    close_fd(out_fd_);
+    close_fd(err_fd_);
+}
+
+bool ChildPipeIOStream::write_buffered(std::string_view data, bool newline)
+{
+    constexpr size_t kWriteBufferSize = 64 * 1024;
+
+    if (out_fd_ < 0) {
+        LogError << "pout is not good" << VAR(exec_) << VAR(args_) << VAR(pid_);
+        return false;
+    }
+
+    write_buffer_.append(data);
+    if (newline) {
+        write_buffer_.push_back('\n');
+    }
+    // as a stream buffer would, write out once it is full
+    return write_buffer_.size() < kWriteBufferSize || flush();
+}
+
+bool ChildPipeIOStream::write_batch(std::span<const std::string_view> messages, bool newline)
+{
+    if (!flush()) {
+        return false;
+    }
+    if (!write_vectored(out_fd_, messages, newline)) {
+        LogError << "writev failed" << VAR(errno) << VAR(exec_) << VAR(args_) << VAR(pid_);
+        return false;
+    }
+    return true;
+}
+
+bool ChildPipeIOStream::flush()
+{
+    if (out_fd_ < 0) {
+        LogError << "pout is not good" << VAR(exec_) << VAR(args_) << VAR(pid_);
+        return false;
+    }
+    return flush_for(duration_t::max());
+}
+
+bool ChildPipeIOStream::flush_for(duration_t timeout)
+{
+    if (write_buffer_.empty()) {
+        return true;
+    }
+
+    std::string_view data = write_buffer_;
+    bool ret = write_vectored(out_fd_, std::span<const std::string_view>(&data, 1), false, timeout);
+    size_t size = write_buffer_.size();
+    write_buffer_.clear();
+    if (!ret) {
+        LogError << "write failed" << VAR(errno) << VAR(size) << VAR(exec_) << VAR(args_) << VAR(pid_);
+    }
+    return ret;
+}
+
+bool ChildPipeIOStream::release()
+{
+    if (pid_ < 0) {
+        close_fds();
+        return exit_code_ == 0;
+    }
+
+    if (out_fd_ >= 0) {
+        // a child that stopped reading keeps the pipe full, it must not hold off the kill below
+        flush_for(options_.graceful_period);
+    }
+    // end of input asks a well-behaved child to quit
+    close_fd(out_fd_);
+
+    bool exited = wait_exit(options_.graceful_period);
+    if (!exited && options_.terminate_first) {
+        ::kill(pid_, SIGTERM);
+        exited = wait_exit(options_.graceful_period);
+    }
+    if (!exited) {
+        ::kill(pid_, SIGKILL);
+        wait_exit(duration_t::max());
+    }
+
+    int code = exit_code_;
+    pid_t pid = std::exchange(pid_, -1);
+    close_fds();
+
+    if (code != 0) {
+        LogWarn << "child exit with" << code << VAR(exec_) << VAR(args_) << VAR(pid);
+        return false;
+    }
+
+    return true;
+}
+
+std::future<bool> ChildPipeIOStream::release_async()
+{
+    return std::async(std::launch::async, [this]() { return release(); });
+}
+
+bool ChildPipeIOStream::running()
+{
+    if (pid_ < 0) {
+        return false;
+    }
+    if (!wait_exit(duration_t::zero())) {
+        return true;
+    }
+    // reaped, release() must not signal a pid that may be reused
+    pid_ = -1;
+    return false;
+}
+
+// reaps the child if it exits within `timeout`
+bool ChildPipeIOStream::wait_exit(duration_t timeout)
+{
+    int status = 0;
+    pid_t waited = ::waitpid(pid_, &status, WNOHANG);
+
+    if (waited == 0 && timeout == duration_t::max()) {
+        waited = ::waitpid(pid_, &status, 0);
+    }
+    else if (waited == 0 && timeout > duration_t::zero()) {
+        int pidfd = -1;
+#ifdef SYS_pidfd_open
+        // readable once the process exits, the child is not reaped yet so its pid cannot be reused
+        pidfd = static_cast<int>(::syscall(SYS_pidfd_open, pid_, 0));
+#endif
+        if (pidfd >= 0) {
+            poll_readable(pidfd, timeout);
+            ::close(pidfd);
+            waited = ::waitpid(pid_, &status, WNOHANG);
+        }
+        else {
+            // kernels before 5.3
+            auto start_time = std::chrono::steady_clock::now();
+            while (waited == 0 && duration_since(start_time) < timeout) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                waited = ::waitpid(pid_, &status, WNOHANG);
+            }
+        }
+    }
+
+    if (waited == 0) {
+        return false;
+    }
+    if (waited == pid_) {
+        exit_code_ = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    // otherwise reaped elsewhere, e.g. by a SIGCHLD handler, the exit code is unknown
+    return true;
+}
+
+bool ChildPipeIOStream::is_open() const
+{
+    return in_fd_ >= 0 && !eof_;
+}
+
+std::string ChildPipeIOStream::read_stderr()
+{
+    std::string result;
+    if (err_fd_ < 0) {
+        return result;
+    }
+
+    char buffer[4096];
+    while (true) {
+        ssize_t read = ::read(err_fd_, buffer, sizeof(buffer));
+        if (read > 0) {
+            result.append(buffer, static_cast<size_t>(read));
+            continue;
+        }
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read == 0) {
+            close_fd(err_fd_);
+        }
+        break;
+    }
+    return result;
+}
+
+bool ChildPipeIOStream::has_pending_output()
+{
+    if (has_buffered_input()) {
+        return true;
+    }
+    return is_open() && poll_readable(in_fd_, duration_t::zero());
+}
+
+std::string ChildPipeIOStream::read_once(size_t max_count)
+{
+    constexpr size_t kBufferSize = 128 * 1024;
+
+    std::string result(std::min(kBufferSize, max_count), '\0');
+    result.resize(read_once_into(result));
+    return result;
+}
+
+size_t ChildPipeIOStream::read_once_into(std::span<char> buffer)
+{
+    size_t done = 0;
+    while (done < buffer.size()) {
+        size_t read = read_available(buffer.data() + done, buffer.size() - done);
+        if (read == 0) {
+            break;
+        }
+        done += read;
+    }
+    return done;
+}
+
+size_t ChildPipeIOStream::read_available(char* buffer, size_t max_count)
+{
+    if (max_count == 0 || !is_open()) {
+        return 0;
+    }
+
+    while (true) {
+        ssize_t read = ::read(in_fd_, buffer, max_count);
+        if (read > 0) {
+            return static_cast<size_t>(read);
+        }
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            poll_readable(in_fd_, duration_t::max());
+            continue;
+        }
+
+        // 0 is the end of the stream
+        eof_ = true;
+        return 0;
+    }
+}
+
+bool ChildPipeIOStream::wait_readable(duration_t timeout)
+{
+    if (!is_open()) {
+        return true;
+    }
+    return poll_readable(in_fd_, timeout);
+}
+
+MAA_NS_END
+
+#endif
@@ -0,0 +1,249 @@
+#include "MaaUtils/IOStream/ChildProcessPool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include "MaaUtils/Logger.h"
+
+MAA_NS_BEGIN
+
+namespace
+{
+struct PoolKey
+{
+    std::filesystem::path exec;
+    std::vector<std::string> args;
+
+    bool operator<(const PoolKey& other) const { return std::tie(exec, args) < std::tie(other.exec, other.args); }
+};
+
+struct PoolEntry
+{
+    std::deque<std::unique_ptr<ChildPipeIOStream>> idle;
+    size_t starting = 0;
+    // not refilled before this after a start failed
+    std::chrono::steady_clock::time_point retry_after;
+};
+}
+
+struct ChildProcessPool::State
+{
+    size_t warm_count = 0;
+    ChildPipeOptions options;
+    HealthCheck health_check;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    bool exit = false;
+
+    std::map<PoolKey, PoolEntry> entries;
+    // leases given back, checked by the worker before they are idle again
+    std::deque<std::pair<PoolKey, std::unique_ptr<ChildPipeIOStream>>> returned;
+
+    std::unique_ptr<ChildPipeIOStream> start(const PoolKey& key) const
+    {
+        try {
+            auto child = std::make_unique<ChildPipeIOStream>(key.exec, key.args, options);
+            if (!child->is_open()) {
+                return nullptr;
+            }
+            return child;
+        }
+        catch (const std::exception& e) {
+            LogError << "failed to start child" << VAR(key.exec) << VAR(key.args) << VAR(e.what());
+            return nullptr;
+        }
+    }
+
+    static bool needs_refill(const PoolEntry& entry, size_t warm_count)
+    {
+        return entry.idle.size() + entry.starting < warm_count && std::chrono::steady_clock::now() >= entry.retry_after;
+    }
+
+    bool needs_refill() const
+    {
+        return std::ranges::any_of(entries, [&](const auto& pair) { return needs_refill(pair.second, warm_count); });
+    }
+};
+
+ChildProcessPool::ChildProcessPool(size_t warm_count, ChildPipeOptions options, HealthCheck health_check)
+    : state_(std::make_shared<State>())
+{
+    LogFunc << VAR(warm_count);
+
+    state_->warm_count = warm_count;
+    state_->options = std::move(options);
+    state_->health_check = std::move(health_check);
+
+    worker_ = std::thread(&ChildProcessPool::working, this);
+}
+
+ChildProcessPool::~ChildProcessPool()
+{
+    LogFunc;
+
+    {
+        std::unique_lock lock(state_->mutex);
+        state_->exit = true;
+    }
+    state_->cond.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+
+    // the children release() themselves outside the lock
+    decltype(state_->entries) entries;
+    decltype(state_->returned) returned;
+    {
+        std::unique_lock lock(state_->mutex);
+        entries = std::move(state_->entries);
+        returned = std::move(state_->returned);
+    }
+}
+
+void ChildProcessPool::prewarm(const std::filesystem::path& exec, const std::vector<std::string>& args)
+{
+    {
+        std::unique_lock lock(state_->mutex);
+        state_->entries.try_emplace(PoolKey { exec, args });
+    }
+    state_->cond.notify_all();
+}
+
+std::shared_ptr<ChildPipeIOStream> ChildProcessPool::acquire(const std::filesystem::path& exec, const std::vector<std::string>& args)
+{
+    PoolKey key { exec, args };
+    std::unique_ptr<ChildPipeIOStream> child;
+
+    {
+        // only prewarm() adds keys, so arbitrary (exec, args) do not pile up entries
+        std::unique_lock lock(state_->mutex);
+        auto it = state_->entries.find(key);
+        while (it != state_->entries.end() && !child && !it->second.idle.empty()) {
+            auto& idle = it->second.idle;
+            child = std::move(idle.front());
+            idle.pop_front();
+            if (!child->running()) {
+                // died while idle, the worker has not noticed yet
+                child.reset();
+            }
+        }
+    }
+    state_->cond.notify_all();
+
+    if (!child) {
+        LogDebug << "no warm child, starting one" << VAR(exec) << VAR(args);
+        child = state_->start(key);
+        if (!child) {
+            return nullptr;
+        }
+    }
+
+    std::weak_ptr<State> weak_state = state_;
+    return std::shared_ptr<ChildPipeIOStream>(child.release(), [weak_state, key](ChildPipeIOStream* leased) {
+        std::unique_ptr<ChildPipeIOStream> owned(leased);
+        auto state = weak_state.lock();
+        if (!state || !owned->is_open()) {
+            // the pool is gone or the child is done, its destructor releases it
+            return;
+        }
+
+        {
+            std::unique_lock lock(state->mutex);
+            if (state->exit) {
+                return;
+            }
+            state->returned.emplace_back(key, std::move(owned));
+        }
+        state->cond.notify_all();
+    });
+}
+
+size_t ChildProcessPool::idle_count(const std::filesystem::path& exec, const std::vector<std::string>& args) const
+{
+    std::unique_lock lock(state_->mutex);
+    auto it = state_->entries.find(PoolKey { exec, args });
+    return it == state_->entries.end() ? 0 : it->second.idle.size();
+}
+
+void ChildProcessPool::working()
+{
+    using namespace std::chrono_literals;
+
+    auto& state = *state_;
+
+    while (true) {
+        decltype(state.returned) returned;
+        std::vector<PoolKey> to_start;
+        // released outside the lock, their teardown may take the graceful period
+        std::vector<std::unique_ptr<ChildPipeIOStream>> retired;
+
+        {
+            std::unique_lock lock(state.mutex);
+            // also wakes up periodically to notice children that died while idle
+            state.cond.wait_for(lock, 1s, [&]() { return state.exit || !state.returned.empty() || state.needs_refill(); });
+            if (state.exit) {
+                break;
+            }
+
+            returned = std::move(state.returned);
+
+            for (auto& [key, entry] : state.entries) {
+                std::erase_if(entry.idle, [&](auto& child) {
+                    if (child->running()) {
+                        return false;
+                    }
+                    retired.emplace_back(std::move(child));
+                    return true;
+                });
+
+                while (State::needs_refill(entry, state.warm_count)) {
+                    ++entry.starting;
+                    to_start.emplace_back(key);
+                }
+            }
+        }
+
+        for (auto& [key, child] : returned) {
+            // output left by the last lessee, or by the health check, would be read by the next one
+            if (!child->running() || child->has_pending_output() || (state.health_check && !state.health_check(*child))
+                || child->has_pending_output()) {
+                LogDebug << "drop returned child" << VAR(key.exec) << VAR(key.args);
+                retired.emplace_back(std::move(child));
+                continue;
+            }
+
+            std::unique_lock lock(state.mutex);
+            auto it = state.entries.find(key);
+            if (it != state.entries.end() && it->second.idle.size() < state.warm_count) {
+                it->second.idle.emplace_back(std::move(child));
+            }
+            else {
+                retired.emplace_back(std::move(child));
+            }
+        }
+
+        for (const auto& key : to_start) {
+            auto child = state.start(key);
+
+            std::unique_lock lock(state.mutex);
+            auto& entry = state.entries[key];
+            --entry.starting;
+            if (child) {
+                entry.idle.emplace_back(std::move(child));
+            }
+            else {
+                entry.retry_after = std::chrono::steady_clock::now() + 1s;
+            }
+        }
+
+        retired.clear();
+    }
+}
+
+MAA_NS_END
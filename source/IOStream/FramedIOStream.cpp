@@ -0,0 +1,117 @@
+#include "MaaUtils/IOStream/FramedIOStream.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "MaaUtils/Logger.h"
+#include "MaaUtils/Time.hpp"
+
+MAA_NS_BEGIN
+
+FramedIOStream::FramedIOStream(std::shared_ptr<IOStream> stream, bool typed, size_t max_frame_size)
+    : stream_(std::move(stream))
+    , typed_(typed)
+    , max_frame_size_(std::min<size_t>(max_frame_size, std::numeric_limits<uint32_t>::max()))
+{
+}
+
+bool FramedIOStream::write_frame(std::string_view payload, uint8_t type)
+{
+    return write_frames(std::span<const std::string_view>(&payload, 1), type);
+}
+
+bool FramedIOStream::write_frames(std::span<const std::string_view> payloads, uint8_t type)
+{
+    std::vector<Header> headers(payloads.size());
+    std::vector<std::string_view> parts;
+    parts.reserve(payloads.size() * 2);
+
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        if (payloads[i].size() > max_frame_size_) {
+            LogError << "frame too large" << VAR(payloads[i].size()) << VAR(max_frame_size_);
+            return false;
+        }
+        make_header(headers[i], payloads[i].size(), type);
+        parts.emplace_back(headers[i].data(), header_size());
+        parts.emplace_back(payloads[i]);
+    }
+
+    return stream_->write_batch(parts, false);
+}
+
+bool FramedIOStream::write_frame_parts(std::span<const std::string_view> parts, uint8_t type)
+{
+    size_t size = 0;
+    for (const auto& part : parts) {
+        size += part.size();
+    }
+    if (size > max_frame_size_) {
+        LogError << "frame too large" << VAR(size) << VAR(max_frame_size_);
+        return false;
+    }
+
+    Header header {};
+    make_header(header, size, type);
+
+    std::vector<std::string_view> all;
+    all.reserve(parts.size() + 1);
+    all.emplace_back(header.data(), header_size());
+    all.insert(all.end(), parts.begin(), parts.end());
+
+    return stream_->write_batch(all, false);
+}
+
+std::optional<FramedIOStream::Frame> FramedIOStream::read_frame(duration_t timeout)
+{
+    auto start_time = std::chrono::steady_clock::now();
+
+    if (!pending_) {
+        Header header {};
+        if (!stream_->read_exact(std::span<char>(header.data(), header_size()), timeout)) {
+            return std::nullopt;
+        }
+
+        uint32_t size = 0;
+        for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+            size |= static_cast<uint32_t>(static_cast<uint8_t>(header[i])) << (i * 8);
+        }
+        uint8_t type = typed_ ? static_cast<uint8_t>(header[sizeof(uint32_t)]) : 0;
+
+        pending_ = PendingHeader { .size = size, .type = type };
+    }
+
+    if (pending_->size > max_frame_size_) {
+        // the header stays pending, the stream cannot be resynchronized
+        LogError << "frame too large" << VAR(pending_->size) << VAR(max_frame_size_);
+        return std::nullopt;
+    }
+
+    // keeps its capacity, large frames are not reallocated each time
+    buffer_.resize(pending_->size);
+
+    duration_t remaining = timeout;
+    if (timeout != duration_t::max()) {
+        remaining = std::max(duration_t::zero(), timeout - duration_since(start_time));
+    }
+    if (!stream_->read_exact(buffer_, remaining)) {
+        return std::nullopt;
+    }
+
+    Frame frame { .type = pending_->type, .payload = buffer_ };
+    pending_.reset();
+    return frame;
+}
+
+void FramedIOStream::make_header(Header& header, size_t size, uint8_t type) const
+{
+    auto value = static_cast<uint32_t>(size);
+    for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+        header[i] = static_cast<char>((value >> (i * 8)) & 0xFF);
+    }
+    if (typed_) {
+        header[sizeof(uint32_t)] = static_cast<char>(type);
+    }
+}
+
+MAA_NS_END
@@ -1,9 +1,28 @@
 #include "MaaUtils/IOStream/IOStream.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "MaaUtils/Logger.h"
 #include "MaaUtils/Time.hpp"
 
 MAA_NS_BEGIN
 
+bool IOStream::write(std::string_view data)
+{
+    return write_buffered(data) && flush();
+}
+
+bool IOStream::write_batch(std::span<const std::string_view> messages, bool newline)
+{
+    for (const auto& msg : messages) {
+        if (!write_buffered(msg, newline)) {
+            return false;
+        }
+    }
+    return flush();
+}
+
 std::string IOStream::read(duration_t timeout)
 {
     return read_some(std::numeric_limits<size_t>::max(), timeout);
@@ -11,12 +30,20 @@ std::string IOStream::read(duration_t timeout)
 
 std::string IOStream::read_some(size_t count, duration_t timeout)
 {
+    constexpr size_t kChunkSize = 128 * 1024;
+
     auto start_time = std::chrono::steady_clock::now();
-    std::string result;
+    std::string result = take_read_buffer(count);
 
-    while (is_open() && result.size() < count && duration_since(start_time) < timeout) {
-        auto data = read_once(count - result.size());
-        result.append(std::move(data));
+    while (is_open() && result.size() < count) {
+        size_t size = result.size();
+        size_t chunk = std::min(count - size, kChunkSize);
+        result.resize(size + chunk);
+        size_t read = read_before(std::span<char>(result).subspan(size, chunk), start_time, timeout);
+        result.resize(size + read);
+        if (read == 0) {
+            break;
+        }
     }
 
     return result;
@@ -24,15 +51,180 @@ std::string IOStream::read_some(size_t count, duration_t timeout)
 
 std::string IOStream::read_until(std::string_view delimiter, duration_t timeout)
 {
+    if (delimiter.empty()) {
+        return {};
+    }
+
     auto start_time = std::chrono::steady_clock::now();
-    std::string result;
+    // unread bytes before this offset are known not to start a delimiter
+    size_t scanned = 0;
+
+    while (true) {
+        auto unread = std::string_view(read_buffer_).substr(read_pos_);
+        // string_view::find locates the first byte with memchr before comparing the rest
+        size_t pos = unread.find(delimiter, scanned);
+        if (pos != std::string_view::npos) {
+            return take_read_buffer(pos + delimiter.size());
+        }
+        scanned = unread.size() - std::min(unread.size(), delimiter.size() - 1);
 
-    while (is_open() && !result.ends_with(delimiter) && duration_since(start_time) < timeout) {
-        auto data = read_once(1);
-        result.append(std::move(data));
+        auto remaining = remaining_time(start_time, timeout);
+        if (!is_open() || remaining <= duration_t::zero()) {
+            break;
+        }
+        if (timeout != duration_t::max() && !wait_readable(remaining)) {
+            break;
+        }
+        if (fill_read_buffer() == 0 && !is_open()) {
+            break;
+        }
     }
 
+    return take_read_buffer(std::numeric_limits<size_t>::max());
+}
+
+size_t IOStream::read_into(std::span<char> buffer)
+{
+    if (buffer.empty()) {
+        return 0;
+    }
+    if (size_t taken = take_read_buffer(buffer)) {
+        return taken;
+    }
+    if (!is_open()) {
+        return 0;
+    }
+    return read_available(buffer.data(), buffer.size());
+}
+
+bool IOStream::read_exact(std::span<char> buffer, duration_t timeout)
+{
+    auto start_time = std::chrono::steady_clock::now();
+    size_t done = take_read_buffer(buffer);
+
+    while (done < buffer.size() && is_open()) {
+        size_t read = read_before(buffer.subspan(done), start_time, timeout);
+        if (read == 0) {
+            break;
+        }
+        done += read;
+    }
+
+    if (done < buffer.size()) {
+        // put the partial data back, a retry starts from the same byte
+        read_buffer_.insert(read_pos_, buffer.data(), done);
+        return false;
+    }
+    return true;
+}
+
+std::string_view IOStream::read_view(size_t max_count)
+{
+    if (read_pos_ == read_buffer_.size() && is_open()) {
+        fill_read_buffer();
+    }
+
+    size_t count = std::min(max_count, read_buffer_.size() - read_pos_);
+    std::string_view view(read_buffer_.data() + read_pos_, count);
+    // only advanced, the bytes stay in place until the next read
+    read_pos_ += count;
+    return view;
+}
+
+bool IOStream::wait_for_input(duration_t timeout)
+{
+    return has_buffered_input() || !is_open() || wait_readable(timeout);
+}
+
+size_t IOStream::read_once_into(std::span<char> buffer)
+{
+    auto data = read_once(buffer.size());
+    std::memcpy(buffer.data(), data.data(), data.size());
+    return data.size();
+}
+
+size_t IOStream::read_available(char* buffer, size_t max_count)
+{
+    if (max_count == 0) {
+        return 0;
+    }
+
+    auto data = read_once(1);
+    std::memcpy(buffer, data.data(), data.size());
+    return data.size();
+}
+
+bool IOStream::wait_readable(duration_t)
+{
+    return true;
+}
+
+IOStream::duration_t IOStream::remaining_time(const std::chrono::steady_clock::time_point& start_time, duration_t timeout)
+{
+    if (timeout == duration_t::max()) {
+        return timeout;
+    }
+    return timeout - duration_since(start_time);
+}
+
+// an exact read without a deadline, otherwise whatever arrives before it, 0 once it passes
+size_t IOStream::read_before(std::span<char> buffer, const std::chrono::steady_clock::time_point& start_time, duration_t timeout)
+{
+    if (timeout == duration_t::max()) {
+        return read_once_into(buffer);
+    }
+
+    auto remaining = remaining_time(start_time, timeout);
+    if (remaining <= duration_t::zero() || !wait_readable(remaining)) {
+        return 0;
+    }
+    return read_available(buffer.data(), buffer.size());
+}
+
+size_t IOStream::fill_read_buffer()
+{
+    constexpr size_t kChunkSize = 4096;
+
+    if (read_pos_ > 0) {
+        read_buffer_.erase(0, read_pos_);
+        read_pos_ = 0;
+    }
+
+    size_t size = read_buffer_.size();
+    read_buffer_.resize(size + kChunkSize);
+    size_t read = read_available(read_buffer_.data() + size, kChunkSize);
+    read_buffer_.resize(size + read);
+    return read;
+}
+
+std::string IOStream::take_read_buffer(size_t count)
+{
+    size_t unread = read_buffer_.size() - read_pos_;
+    if (read_pos_ == 0 && count >= unread) {
+        return std::exchange(read_buffer_, {});
+    }
+
+    count = std::min(count, unread);
+    std::string result = read_buffer_.substr(read_pos_, count);
+    consume_read_buffer(count);
     return result;
 }
 
+size_t IOStream::take_read_buffer(std::span<char> buffer)
+{
+    size_t count = std::min(buffer.size(), read_buffer_.size() - read_pos_);
+    std::memcpy(buffer.data(), read_buffer_.data() + read_pos_, count);
+    consume_read_buffer(count);
+    return count;
+}
+
+void IOStream::consume_read_buffer(size_t count)
+{
+    read_pos_ += count;
+    if (read_pos_ == read_buffer_.size()) {
+        read_buffer_.clear();
+        read_pos_ = 0;
+    }
+}
+
 MAA_NS_END
@@ -0,0 +1,75 @@
+#include "MaaUtils/IOStream/LocalSockIOStream.h"
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+#include <filesystem>
+
+#include "MaaUtils/Logger.h"
+
+MAA_NS_BEGIN
+
+static boost::asio::local::stream_protocol::endpoint local_endpoint(const std::string& path, bool abstract)
+{
+    // a leading NUL selects the abstract namespace
+    return boost::asio::local::stream_protocol::endpoint(abstract ? std::string(1, '\0') + path : path);
+}
+
+// only a socket is removed, never a regular file or whatever a symlink at `path` points to
+static void remove_socket_file(const std::string& path)
+{
+    std::error_code ec;
+    if (std::filesystem::is_socket(std::filesystem::symlink_status(path, ec))) {
+        std::filesystem::remove(path, ec);
+    }
+}
+
+ServerLocalSockIOFactory::ServerLocalSockIOFactory(const std::string& path, bool abstract)
+    : BasicServerSockIOFactory(LocalSockOptions {})
+    , path_(path)
+    , abstract_(abstract)
+{
+    LogFunc << VAR(path) << VAR(abstract);
+
+    auto endpoint = local_endpoint(path_, abstract_);
+
+    if (!abstract_) {
+        // a socket left behind by a crashed server would fail the bind, one that still accepts belongs to a live server
+        boost::asio::local::stream_protocol::socket probe(io_ctx_);
+        boost::system::error_code ec;
+        probe.connect(endpoint, ec);
+        if (ec) {
+            remove_socket_file(path_);
+        }
+    }
+
+    server_acceptor_.open(endpoint.protocol());
+    server_acceptor_.bind(endpoint);
+    owns_path_ = !abstract_;
+
+    server_acceptor_.listen();
+}
+
+ServerLocalSockIOFactory::~ServerLocalSockIOFactory()
+{
+    server_acceptor_.close();
+
+    if (owns_path_) {
+        remove_socket_file(path_);
+    }
+}
+
+ClientLocalSockIOFactory::ClientLocalSockIOFactory(const std::string& path, bool abstract, const LocalSockOptions& options)
+    : BasicClientSockIOFactory(local_endpoint(path, abstract), options)
+{
+    LogFunc << VAR(path) << VAR(abstract);
+}
+
+LocalSockIOStream::LocalSockIOStream(boost::asio::local::stream_protocol::iostream&& ios, const LocalSockOptions& options)
+    : BasicSockIOStream(std::move(ios))
+{
+    std::ignore = options;
+}
+
+MAA_NS_END
+
+#endif
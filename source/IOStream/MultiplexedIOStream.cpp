@@ -0,0 +1,157 @@
+#include "MaaUtils/IOStream/MultiplexedIOStream.h"
+
+#include <array>
+
+#include "MaaUtils/Logger.h"
+
+MAA_NS_BEGIN
+
+namespace
+{
+// frame type, the payload starts with the request id as u64 little endian
+enum class mux_frame : uint8_t
+{
+    request = 1,
+    response = 2,
+};
+
+constexpr size_t kIdSize = sizeof(uint64_t);
+}
+
+MultiplexedIOStream::MultiplexedIOStream(std::shared_ptr<IOStream> stream, RequestHandler on_request)
+    : framed_(std::move(stream), true)
+    , on_request_(std::move(on_request))
+{
+    reader_ = std::thread(&MultiplexedIOStream::reading, this);
+}
+
+MultiplexedIOStream::~MultiplexedIOStream()
+{
+    exit_ = true;
+    {
+        // wakes a reader blocked inside a frame, under the lock so no write is in between
+        std::unique_lock lock(write_mutex_);
+        framed_.stream()->shutdown_read();
+    }
+    if (reader_.joinable()) {
+        reader_.join();
+    }
+    close_pending();
+}
+
+std::future<MultiplexedIOStream::Response> MultiplexedIOStream::request(std::string_view payload)
+{
+    uint64_t id = next_id_++;
+
+    std::promise<Response> promise;
+    auto future = promise.get_future();
+    {
+        std::unique_lock lock(pending_mutex_);
+        if (closed_) {
+            promise.set_value(std::nullopt);
+            return future;
+        }
+        pending_.emplace(id, std::move(promise));
+    }
+
+    if (!send(static_cast<uint8_t>(mux_frame::request), id, payload)) {
+        std::unique_lock lock(pending_mutex_);
+        if (auto node = pending_.extract(id)) {
+            node.mapped().set_value(std::nullopt);
+        }
+    }
+    return future;
+}
+
+bool MultiplexedIOStream::respond(uint64_t id, std::string_view payload)
+{
+    return send(static_cast<uint8_t>(mux_frame::response), id, payload);
+}
+
+bool MultiplexedIOStream::send(uint8_t type, uint64_t id, std::string_view payload)
+{
+    std::array<char, kIdSize> id_bytes {};
+    for (size_t i = 0; i < kIdSize; ++i) {
+        id_bytes[i] = static_cast<char>((id >> (i * 8)) & 0xFF);
+    }
+    std::string_view parts[] = { std::string_view(id_bytes.data(), kIdSize), payload };
+
+    std::unique_lock lock(write_mutex_);
+    return framed_.write_frame_parts(parts, type);
+}
+
+void MultiplexedIOStream::reading()
+{
+    using namespace std::chrono_literals;
+
+    while (!exit_) {
+        // Waits between frames so the destructor is noticed, without consuming anything.
+        // A timeout inside read_frame() would put a partly received payload back and copy it again on every retry.
+        if (!framed_.stream()->wait_for_input(100ms)) {
+            continue;
+        }
+
+        auto frame = framed_.read_frame();
+        if (!frame) {
+            if (!exit_ && framed_.is_open()) {
+                // without a timeout only a frame over the size limit fails while the stream is open,
+                // its header stays pending and every later read would fail the same way
+                LogError << "unreadable frame, closing the stream";
+                // not in the middle of a send() on another thread
+                std::unique_lock lock(write_mutex_);
+                framed_.stream()->release();
+            }
+            break;
+        }
+
+        if (frame->payload.size() < kIdSize) {
+            LogError << "mux frame too short" << VAR(frame->payload.size());
+            continue;
+        }
+        uint64_t id = 0;
+        for (size_t i = 0; i < kIdSize; ++i) {
+            id |= static_cast<uint64_t>(static_cast<uint8_t>(frame->payload[i])) << (i * 8);
+        }
+        auto payload = frame->payload.substr(kIdSize);
+
+        switch (static_cast<mux_frame>(frame->type)) {
+        case mux_frame::request:
+            if (on_request_) {
+                on_request_(id, payload);
+            }
+            else {
+                LogWarn << "no request handler, answer empty" << VAR(id);
+                respond(id, {});
+            }
+            break;
+
+        case mux_frame::response: {
+            std::unique_lock lock(pending_mutex_);
+            if (auto node = pending_.extract(id)) {
+                node.mapped().set_value(std::string(payload));
+            }
+            else {
+                LogWarn << "response to unknown request" << VAR(id);
+            }
+        } break;
+
+        default:
+            LogError << "unknown mux frame" << VAR(frame->type);
+            break;
+        }
+    }
+
+    close_pending();
+}
+
+void MultiplexedIOStream::close_pending()
+{
+    std::unique_lock lock(pending_mutex_);
+    closed_ = true;
+    for (auto& [id, promise] : pending_) {
+        promise.set_value(std::nullopt);
+    }
+    pending_.clear();
+}
+
+MAA_NS_END
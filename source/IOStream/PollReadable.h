@@ -0,0 +1,46 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <poll.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <limits>
+
+#include "MaaUtils/Conf.h"
+#include "MaaUtils/Time.hpp"
+
+MAA_NS_BEGIN
+
+// Waits until `fd` is readable, hung up or in error, false if `timeout` passes first.
+inline bool poll_readable(int fd, std::chrono::milliseconds timeout)
+{
+    auto start_time = std::chrono::steady_clock::now();
+
+    while (true) {
+        int wait_ms = -1;
+        if (timeout != std::chrono::milliseconds::max()) {
+            auto remaining = timeout - duration_since(start_time);
+            wait_ms = static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(remaining.count(), 0, std::numeric_limits<int>::max()));
+        }
+
+        pollfd pfd { .fd = fd, .events = POLLIN, .revents = 0 };
+        int ret = ::poll(&pfd, 1, wait_ms);
+        if (ret > 0) {
+            return true;
+        }
+        if (ret == 0) {
+            return false;
+        }
+        if (errno != EINTR) {
+            // let the read itself report the broken fd
+            return true;
+        }
+    }
+}
+
+MAA_NS_END
+
+#endif
@@ -0,0 +1,512 @@
+#ifdef __linux__
+
+#include "MaaUtils/IOStream/ShmIOStream.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include "MaaUtils/IOStream/ChildPipeIOStream.h"
+#include "MaaUtils/Logger.h"
+#include "MaaUtils/Time.hpp"
+#include "PollReadable.h"
+
+MAA_NS_BEGIN
+
+struct ShmRing
+{
+    // total bytes produced / consumed, they only grow
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    // futex words, bumped after data arrives / space frees up
+    alignas(64) std::atomic<uint32_t> data_seq;
+    std::atomic<uint32_t> data_waiters;
+    alignas(64) std::atomic<uint32_t> space_seq;
+    std::atomic<uint32_t> space_waiters;
+};
+
+struct ShmHeader
+{
+    uint64_t magic = 0;
+    uint64_t capacity = 0;
+    // set by either side on release, or once the other side's process is gone; the rings drain and then end
+    std::atomic<uint32_t> closed;
+    // of the creator and the attacher, 0 while unknown
+    std::atomic<int32_t> pids[2];
+    // [0] creator to attacher, [1] attacher to creator
+    ShmRing rings[2];
+};
+
+// the region is shared between processes, so the atomics must not fall back to locks
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free);
+
+namespace
+{
+constexpr uint64_t kShmMagic = 0x314D485341414DULL; // "MAASHM1"
+// futex waits are cut into slices of this length to look for a dead peer, which never wakes them
+constexpr std::chrono::milliseconds kPeerCheckInterval(100);
+
+// returns false on timeout
+bool futex_wait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::milliseconds timeout)
+{
+    timespec ts {};
+    timespec* pts = nullptr;
+    if (timeout != std::chrono::milliseconds::max()) {
+        auto ms = std::max<int64_t>(timeout.count(), 0);
+        ts.tv_sec = static_cast<time_t>(ms / 1000);
+        ts.tv_nsec = static_cast<long>(ms % 1000) * 1'000'000;
+        pts = &ts;
+    }
+    // not FUTEX_PRIVATE_FLAG, the word is shared with another process
+    long ret = ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, pts, nullptr, 0);
+    return !(ret == -1 && errno == ETIMEDOUT);
+}
+
+void futex_wake(std::atomic<uint32_t>& word)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void bump_and_wake(std::atomic<uint32_t>& seq, const std::atomic<uint32_t>& waiters)
+{
+    seq.fetch_add(1);
+    if (waiters.load() > 0) {
+        futex_wake(seq);
+    }
+}
+
+size_t mapped_size_for(size_t capacity)
+{
+    return sizeof(ShmHeader) + capacity * 2;
+}
+
+// the largest capacity whose rings fit in `size` bytes, without overflowing
+size_t max_capacity_for(size_t size)
+{
+    return size < sizeof(ShmHeader) ? 0 : (size - sizeof(ShmHeader)) / 2;
+}
+}
+
+std::shared_ptr<ShmIOStream> ShmIOStream::create(size_t capacity)
+{
+    LogFunc << VAR(capacity);
+
+    if (capacity == 0 || capacity > max_capacity_for(std::numeric_limits<off_t>::max())) {
+        LogError << "invalid capacity" << VAR(capacity);
+        return nullptr;
+    }
+
+    int fd = ::memfd_create("maa-shm-iostream", MFD_CLOEXEC);
+    if (fd < 0) {
+        LogError << "memfd_create failed" << VAR(errno);
+        return nullptr;
+    }
+
+    size_t size = mapped_size_for(capacity);
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        LogError << "ftruncate failed" << VAR(errno) << VAR(size);
+        ::close(fd);
+        return nullptr;
+    }
+
+    void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        LogError << "mmap failed" << VAR(errno) << VAR(size);
+        ::close(fd);
+        return nullptr;
+    }
+
+    // the fresh memfd is zero filled, which is the initial state of every counter
+    auto* header = new (base) ShmHeader;
+    header->capacity = capacity;
+    header->pids[0].store(::getpid());
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = kShmMagic;
+
+    return std::shared_ptr<ShmIOStream>(new ShmIOStream(fd, base, size, capacity, true));
+}
+
+std::shared_ptr<ShmIOStream> ShmIOStream::attach(int fd)
+{
+    LogFunc << VAR(fd);
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ShmHeader)) {
+        LogError << "invalid shm fd" << VAR(fd) << VAR(errno);
+        return nullptr;
+    }
+
+    auto size = static_cast<size_t>(st.st_size);
+    void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        LogError << "mmap failed" << VAR(errno) << VAR(size);
+        return nullptr;
+    }
+
+    auto* header = static_cast<ShmHeader*>(base);
+    if (header->magic != kShmMagic) {
+        LogError << "not a shm iostream" << VAR(fd) << VAR(size);
+        ::munmap(base, size);
+        return nullptr;
+    }
+
+    // read once, the peer could change the header after the check
+    uint64_t capacity = header->capacity;
+    // create() sized the memfd for exactly this capacity, compared without overflowing
+    if (capacity == 0 || capacity > max_capacity_for(size) || mapped_size_for(static_cast<size_t>(capacity)) != size) {
+        LogError << "shm capacity does not fit the mapping" << VAR(fd) << VAR(capacity) << VAR(size);
+        ::munmap(base, size);
+        return nullptr;
+    }
+
+    header->pids[1].store(::getpid());
+    // not passed on to the processes this one starts
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    return std::shared_ptr<ShmIOStream>(new ShmIOStream(fd, base, size, static_cast<size_t>(capacity), false));
+}
+
+std::shared_ptr<ShmIOStream> ShmIOStream::attach_from_args(int argc, const char* const* argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (!arg.starts_with(kFdArgPrefix)) {
+            continue;
+        }
+
+        arg.remove_prefix(kFdArgPrefix.size());
+        int fd = -1;
+        auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), fd);
+        if (ec != std::errc() || ptr != arg.data() + arg.size()) {
+            LogError << "invalid shm fd argument" << VAR(argv[i]);
+            return nullptr;
+        }
+        return attach(fd);
+    }
+    return nullptr;
+}
+
+ShmIOStream::ShmIOStream(int fd, void* base, size_t mapped_size, size_t capacity, bool creator)
+    : fd_(fd)
+    , base_(base)
+    , mapped_size_(mapped_size)
+    , capacity_(capacity)
+    , header_(static_cast<ShmHeader*>(base))
+{
+
+    char* data = static_cast<char*>(base) + sizeof(ShmHeader);
+    size_t tx_index = creator ? 0 : 1;
+    size_t rx_index = 1 - tx_index;
+
+    peer_index_ = rx_index;
+
+    tx_ = &header_->rings[tx_index];
+    tx_data_ = data + capacity_ * tx_index;
+    rx_ = &header_->rings[rx_index];
+    rx_data_ = data + capacity_ * rx_index;
+}
+
+ShmIOStream::~ShmIOStream()
+{
+    release();
+}
+
+bool ShmIOStream::write_buffered(std::string_view data, bool newline)
+{
+    if (!header_) {
+        LogError << "shm is released";
+        return false;
+    }
+
+    if (!write_bytes(data)) {
+        return false;
+    }
+    return !newline || write_bytes("\n");
+}
+
+bool ShmIOStream::flush()
+{
+    if (!header_) {
+        LogError << "shm is released";
+        return false;
+    }
+
+    wake_reader();
+    return !header_->closed.load(std::memory_order_acquire);
+}
+
+bool ShmIOStream::release()
+{
+    if (!header_) {
+        return true;
+    }
+
+    close_rings();
+
+    bool ret = ::munmap(base_, mapped_size_) == 0;
+    ret = ::close(fd_) == 0 && ret;
+    if (!ret) {
+        LogError << "failed to unmap shm" << VAR(errno);
+    }
+
+    {
+        std::unique_lock lock(peer_mutex_);
+        if (peer_pidfd_ >= 0) {
+            ::close(peer_pidfd_);
+            peer_pidfd_ = -1;
+        }
+    }
+
+    header_ = nullptr;
+    base_ = nullptr;
+    fd_ = -1;
+    return ret;
+}
+
+bool ShmIOStream::is_open() const
+{
+    if (!header_) {
+        return false;
+    }
+    // still open while the peer's last bytes are unread
+    return !header_->closed.load(std::memory_order_acquire)
+           || rx_->head.load(std::memory_order_acquire) != rx_->tail.load(std::memory_order_relaxed);
+}
+
+std::string ShmIOStream::read_once(size_t max_count)
+{
+    std::string result(max_count, '\0');
+    result.resize(read_once_into(result));
+    return result;
+}
+
+size_t ShmIOStream::read_once_into(std::span<char> buffer)
+{
+    size_t done = 0;
+    while (done < buffer.size()) {
+        size_t read = read_available(buffer.data() + done, buffer.size() - done);
+        if (read == 0) {
+            break;
+        }
+        done += read;
+    }
+    return done;
+}
+
+size_t ShmIOStream::read_available(char* buffer, size_t max_count)
+{
+    if (max_count == 0 || !wait_readable(duration_t::max()) || !header_) {
+        return 0;
+    }
+
+    uint64_t tail = rx_->tail.load(std::memory_order_relaxed);
+    uint64_t head = rx_->head.load(std::memory_order_acquire);
+    size_t count = std::min<uint64_t>(head - tail, max_count);
+    if (count == 0) {
+        // closed and drained
+        return 0;
+    }
+
+    size_t offset = tail % capacity_;
+    size_t first = std::min(count, capacity_ - offset);
+    std::memcpy(buffer, rx_data_ + offset, first);
+    std::memcpy(buffer + first, rx_data_, count - first);
+
+    rx_->tail.store(tail + count);
+    bump_and_wake(rx_->space_seq, rx_->space_waiters);
+    return count;
+}
+
+bool ShmIOStream::wait_readable(duration_t timeout)
+{
+    auto start_time = std::chrono::steady_clock::now();
+
+    auto ready = [&]() {
+        return header_->closed.load() || rx_->head.load() != rx_->tail.load(std::memory_order_relaxed);
+    };
+
+    while (header_) {
+        if (ready()) {
+            return true;
+        }
+
+        uint32_t seq = rx_->data_seq.load();
+        rx_->data_waiters.fetch_add(1);
+        // a writer publishing after this recheck sees the waiter and wakes us
+        if (ready()) {
+            rx_->data_waiters.fetch_sub(1);
+            return true;
+        }
+
+        duration_t remaining = timeout;
+        if (timeout != duration_t::max()) {
+            remaining = timeout - duration_since(start_time);
+        }
+        duration_t slice = std::min(remaining, kPeerCheckInterval);
+        bool woken = slice > duration_t::zero() && futex_wait(rx_->data_seq, seq, slice);
+        rx_->data_waiters.fetch_sub(1);
+
+        if (woken) {
+            continue;
+        }
+        if (slice > duration_t::zero() && !peer_alive()) {
+            // closed now, the next round returns true
+            close_rings();
+            continue;
+        }
+        if (remaining <= kPeerCheckInterval) {
+            return ready();
+        }
+    }
+    return false;
+}
+
+bool ShmIOStream::write_bytes(std::string_view data)
+{
+    while (!data.empty()) {
+        if (header_->closed.load(std::memory_order_acquire)) {
+            LogError << "shm is closed";
+            return false;
+        }
+
+        uint64_t head = tx_->head.load(std::memory_order_relaxed);
+        uint64_t tail = tx_->tail.load(std::memory_order_acquire);
+        size_t space = capacity_ - static_cast<size_t>(head - tail);
+        if (space == 0) {
+            // the reader may be waiting for a flush that only comes after this write
+            wake_reader();
+            wait_space();
+            continue;
+        }
+
+        size_t count = std::min(space, data.size());
+        size_t offset = head % capacity_;
+        size_t first = std::min(count, capacity_ - offset);
+        std::memcpy(tx_data_ + offset, data.data(), first);
+        std::memcpy(tx_data_, data.data() + first, count - first);
+
+        tx_->head.store(head + count);
+        // bumped without a wake, flush() wakes the reader
+        tx_->data_seq.fetch_add(1);
+        data.remove_prefix(count);
+    }
+    return true;
+}
+
+bool ShmIOStream::wait_space()
+{
+    auto ready = [&]() {
+        return header_->closed.load() || tx_->head.load(std::memory_order_relaxed) - tx_->tail.load() < capacity_;
+    };
+
+    while (!ready()) {
+        uint32_t seq = tx_->space_seq.load();
+        tx_->space_waiters.fetch_add(1);
+        bool woken = ready() || futex_wait(tx_->space_seq, seq, kPeerCheckInterval);
+        tx_->space_waiters.fetch_sub(1);
+
+        if (!woken && !peer_alive()) {
+            close_rings();
+        }
+    }
+    return !header_->closed.load();
+}
+
+void ShmIOStream::close_rings()
+{
+    header_->closed.store(1);
+    // wake both sides of both rings, every waiter rechecks `closed`
+    for (auto& ring : header_->rings) {
+        bump_and_wake(ring.data_seq, ring.data_waiters);
+        bump_and_wake(ring.space_seq, ring.space_waiters);
+    }
+}
+
+bool ShmIOStream::peer_alive()
+{
+    int32_t pid = header_->pids[peer_index_].load();
+    if (pid <= 0) {
+        // not attached yet
+        return true;
+    }
+
+    std::unique_lock lock(peer_mutex_);
+
+    if (pid != peer_pid_) {
+        peer_pid_ = pid;
+        if (peer_pidfd_ >= 0) {
+            ::close(peer_pidfd_);
+        }
+        peer_pidfd_ = -1;
+#ifdef SYS_pidfd_open
+        // readable once the process exits, even while nobody has reaped it
+        peer_pidfd_ = static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+        if (peer_pidfd_ < 0 && errno == ESRCH) {
+            LogError << "shm peer is gone" << VAR(pid);
+            return false;
+        }
+#endif
+    }
+
+    bool alive = peer_pidfd_ >= 0 ? !poll_readable(peer_pidfd_, duration_t::zero())
+                                  // kernels before 5.3, misses a peer that is a zombie
+                                  : ::kill(pid, 0) == 0 || errno != ESRCH;
+    if (!alive) {
+        LogError << "shm peer is gone" << VAR(pid);
+    }
+    return alive;
+}
+
+void ShmIOStream::wake_reader()
+{
+    if (tx_->data_waiters.load() > 0) {
+        futex_wake(tx_->data_seq);
+    }
+}
+
+ShmChildIOFactory::ShmChildIOFactory(size_t capacity)
+    : capacity_(capacity)
+{
+}
+
+std::optional<ShmChildIOFactory::Child> ShmChildIOFactory::launch(const std::filesystem::path& exec, std::vector<std::string> args)
+{
+    LogFunc << VAR(exec) << VAR(args);
+
+    auto stream = ShmIOStream::create(capacity_);
+    if (!stream) {
+        return std::nullopt;
+    }
+
+    ChildPipeOptions options;
+    options.extra_fds = { stream->fd() };
+    // the first of ChildPipeOptions::extra_fds
+    args.emplace_back(std::string(ShmIOStream::kFdArgPrefix) + std::to_string(STDERR_FILENO + 1));
+
+    auto process = std::make_shared<ChildPipeIOStream>(exec, args, options);
+    if (process->pid() < 0) {
+        LogError << "failed to start child" << VAR(exec);
+        return std::nullopt;
+    }
+    // a child that dies before it attaches is noticed too
+    stream->header_->pids[1].store(process->pid());
+
+    return Child { .stream = std::move(stream), .process = std::move(process) };
+}
+
+MAA_NS_END
+
+#endif
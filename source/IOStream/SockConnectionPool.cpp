@@ -0,0 +1,230 @@
+#include "MaaUtils/IOStream/SockConnectionPool.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "MaaUtils/Logger.h"
+
+MAA_NS_BEGIN
+
+namespace
+{
+using PoolKey = std::pair<std::string, uint16_t>;
+
+struct IdleConnection
+{
+    std::shared_ptr<SockIOStream> stream;
+    std::chrono::steady_clock::time_point since;
+};
+
+struct PoolEntry
+{
+    std::unique_ptr<ClientSockIOFactory> factory;
+    // most recently returned at the back
+    std::deque<IdleConnection> idle;
+    // leased, idle and connecting, bounded by max_connections
+    size_t open = 0;
+};
+}
+
+struct SockConnectionPool::State
+{
+    using duration_t = SockPoolOptions::duration_t;
+
+    SockPoolOptions options;
+    Validator validator;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    bool exit = false;
+
+    std::map<PoolKey, PoolEntry> entries;
+
+    // gives up before a backoff would sleep past `deadline`
+    std::shared_ptr<SockIOStream> connect(
+        ClientSockIOFactory& factory,
+        const PoolKey& key,
+        std::chrono::steady_clock::time_point deadline) const
+    {
+        thread_local std::minstd_rand random(std::random_device {}());
+
+        auto backoff = options.backoff_initial;
+        for (size_t attempt = 1;; ++attempt) {
+            if (auto stream = factory.connect()) {
+                return stream;
+            }
+            if (attempt >= options.connect_attempts) {
+                break;
+            }
+
+            // half fixed, half random, so clients that lost the agent together do not retry together
+            auto jitter = std::uniform_int_distribution<duration_t::rep>(0, backoff.count() / 2)(random);
+            auto delay = backoff / 2 + duration_t(jitter);
+            if (std::chrono::steady_clock::now() + delay >= deadline) {
+                LogWarn << "acquire timeout before the next retry" << VAR(key.first) << VAR(key.second) << VAR(attempt);
+                break;
+            }
+            LogWarn << "connect failed, retrying" << VAR(key.first) << VAR(key.second) << VAR(attempt) << VAR(delay);
+            std::this_thread::sleep_for(delay);
+
+            backoff = std::min(backoff * 2, options.backoff_max);
+        }
+
+        LogError << "failed to connect" << VAR(key.first) << VAR(key.second) << VAR(options.connect_attempts);
+        return nullptr;
+    }
+
+    bool usable(SockIOStream& stream) const { return stream.probe_idle() && (!validator || validator(stream)); }
+};
+
+SockConnectionPool::SockConnectionPool(SockPoolOptions options, Validator validator)
+    : state_(std::make_shared<State>())
+{
+    LogFunc << VAR(options.max_idle) << VAR(options.max_connections);
+
+    state_->options = std::move(options);
+    state_->validator = std::move(validator);
+}
+
+SockConnectionPool::~SockConnectionPool()
+{
+    LogFunc;
+
+    // the idle connections close outside the lock, leased ones close when they are dropped
+    decltype(state_->entries) entries;
+    {
+        std::unique_lock lock(state_->mutex);
+        state_->exit = true;
+        entries = std::move(state_->entries);
+    }
+    state_->cond.notify_all();
+}
+
+std::shared_ptr<SockIOStream> SockConnectionPool::acquire(const std::string& address, uint16_t port)
+{
+    auto& state = *state_;
+    const auto& options = state.options;
+
+    PoolKey key { address, port };
+    auto deadline = std::chrono::steady_clock::now() + options.acquire_timeout;
+
+    std::shared_ptr<SockIOStream> stream;
+    ClientSockIOFactory* factory = nullptr;
+
+    while (!stream) {
+        // dropped outside the lock
+        std::vector<std::shared_ptr<SockIOStream>> stale;
+        std::shared_ptr<SockIOStream> candidate;
+
+        {
+            std::unique_lock lock(state.mutex);
+            auto& entry = state.entries[key];
+
+            auto expired = std::chrono::steady_clock::now() - options.idle_timeout;
+            while (!entry.idle.empty() && entry.idle.front().since < expired) {
+                stale.emplace_back(std::move(entry.idle.front().stream));
+                entry.idle.pop_front();
+                --entry.open;
+            }
+            if (!stale.empty()) {
+                // their slots are free for the threads waiting on max_connections
+                state.cond.notify_all();
+            }
+
+            if (!entry.idle.empty()) {
+                candidate = std::move(entry.idle.back().stream);
+                entry.idle.pop_back();
+            }
+            else if (options.max_connections == 0 || entry.open < options.max_connections) {
+                if (!entry.factory) {
+                    try {
+                        entry.factory = std::make_unique<ClientSockIOFactory>(address, port, options.sock);
+                    }
+                    catch (const std::exception& e) {
+                        LogError << "invalid endpoint" << VAR(address) << VAR(port) << VAR(e.what());
+                        return nullptr;
+                    }
+                }
+                factory = entry.factory.get();
+                ++entry.open;
+                break;
+            }
+            else {
+                bool freed = state.cond.wait_until(lock, deadline, [&]() {
+                    return entry.idle.size() > 0 || entry.open < options.max_connections;
+                });
+                if (!freed) {
+                    LogError << "connection limit reached" << VAR(address) << VAR(port) << VAR(options.max_connections);
+                    return nullptr;
+                }
+                continue;
+            }
+        }
+
+        if (state.usable(*candidate)) {
+            stream = std::move(candidate);
+            continue;
+        }
+
+        LogDebug << "drop idle connection" << VAR(address) << VAR(port);
+        stale.emplace_back(std::move(candidate));
+        {
+            std::unique_lock lock(state.mutex);
+            --state.entries[key].open;
+        }
+        state.cond.notify_all();
+    }
+
+    if (!stream) {
+        stream = state.connect(*factory, key, deadline);
+        if (!stream) {
+            {
+                std::unique_lock lock(state.mutex);
+                --state.entries[key].open;
+            }
+            state.cond.notify_all();
+            return nullptr;
+        }
+    }
+
+    // the lease owns the pooled pointer and gives it back from its deleter
+    std::weak_ptr<State> weak_state = state_;
+    auto* leased = stream.get();
+    return std::shared_ptr<SockIOStream>(leased, [weak_state, key, pooled = std::move(stream)](SockIOStream*) mutable {
+        auto owned = std::move(pooled);
+        auto state = weak_state.lock();
+        if (!state) {
+            return;
+        }
+
+        {
+            std::unique_lock lock(state->mutex);
+            if (state->exit) {
+                return;
+            }
+            auto& entry = state->entries[key];
+            if (owned->is_open() && entry.idle.size() < state->options.max_idle) {
+                entry.idle.emplace_back(IdleConnection { std::move(owned), std::chrono::steady_clock::now() });
+            }
+            else {
+                --entry.open;
+            }
+        }
+        state->cond.notify_all();
+        // a dropped connection closes here, outside the lock
+    });
+}
+
+size_t SockConnectionPool::idle_count(const std::string& address, uint16_t port) const
+{
+    std::unique_lock lock(state_->mutex);
+    auto it = state_->entries.find(PoolKey { address, port });
+    return it == state_->entries.end() ? 0 : it->second.idle.size();
+}
+
+MAA_NS_END
@@ -4,120 +4,148 @@
 
 MAA_NS_BEGIN
 
-ServerSockIOFactory::ServerSockIOFactory(const std::string& address, unsigned short port)
-    : server_acceptor_(io_ctx_)
+namespace
 {
-    LogFunc << VAR(address) << VAR(port);
-
-    using namespace boost::asio::ip;
+// An integer option as setsockopt() takes it, for the ones Asio has no type for. Meets SettableSocketOption.
+template <int Level, int Name>
+class IntOption
+{
+public:
+    explicit IntOption(int value)
+        : value_(value)
+    {
+    }
 
-    tcp::endpoint endpoint(address::from_string(address), port);
+    template <typename Protocol>
+    int level(const Protocol&) const
+    {
+        return Level;
+    }
 
-    server_acceptor_.open(endpoint.protocol());
-    server_acceptor_.set_option(tcp::acceptor::reuse_address(true));
-    server_acceptor_.bind(endpoint);
+    template <typename Protocol>
+    int name(const Protocol&) const
+    {
+        return Name;
+    }
 
-    server_acceptor_.listen();
-}
+    template <typename Protocol>
+    const int* data(const Protocol&) const
+    {
+        return &value_;
+    }
 
-ServerSockIOFactory::~ServerSockIOFactory()
-{
-    LogFunc;
+    template <typename Protocol>
+    size_t size(const Protocol&) const
+    {
+        return sizeof(value_);
+    }
 
-    server_acceptor_.close();
-}
+private:
+    int value_ = 0;
+};
 
-uint16_t ServerSockIOFactory::port() const
+// a failed option only costs performance, the connection still works
+template <typename Socket, typename Option>
+void set_option(Socket& socket, const Option& option, std::string_view name)
 {
-    return server_acceptor_.local_endpoint().port();
+    boost::system::error_code ec;
+    socket.set_option(option, ec);
+    if (ec) {
+        LogWarn << "failed to set socket option" << VAR(name) << VAR(ec.message());
+    }
 }
 
-std::shared_ptr<SockIOStream> ServerSockIOFactory::accept()
+// buffer sizes, the only options an acceptor passes on to its connections on every platform
+template <typename Socket>
+void set_buffer_options(Socket& socket, const SockOptions& options)
 {
-    // LogFunc;
-
-    boost::asio::ip::tcp::iostream ios;
-    auto accept_future = std::async(std::launch::async, [&]() { server_acceptor_.accept(*ios.rdbuf()); });
-    if (accept_future.wait_for(std::chrono::seconds(2)) != std::future_status::ready) {
-        LogError << "accept timeout";
-        server_acceptor_.cancel();
-        return nullptr;
+    if (options.send_buffer > 0) {
+        set_option(socket, boost::asio::socket_base::send_buffer_size(options.send_buffer), "SO_SNDBUF");
     }
-
-    if (ios.eof()) {
-        LogError << "socket is not opened";
-        return nullptr;
+    if (options.receive_buffer > 0) {
+        set_option(socket, boost::asio::socket_base::receive_buffer_size(options.receive_buffer), "SO_RCVBUF");
     }
-
-    return std::make_shared<SockIOStream>(std::move(ios));
 }
 
-ClientSockIOFactory::ClientSockIOFactory(const std::string& address, unsigned short port)
-    : endpoint_(boost::asio::ip::address::from_string(address), port)
+template <typename Socket>
+void set_stream_options(Socket& socket, const SockOptions& options)
 {
-    LogFunc << VAR(address) << VAR(port);
-}
+    set_option(socket, boost::asio::ip::tcp::no_delay(options.no_delay), "TCP_NODELAY");
 
-std::shared_ptr<SockIOStream> ClientSockIOFactory::connect()
-{
-    LogFunc;
+    set_buffer_options(socket, options);
 
-    boost::asio::ip::tcp::iostream ios(endpoint_);
-    if (ios.eof()) {
-        LogError << "socket is not opened";
-        return nullptr;
+    if (!options.keep_alive) {
+        return;
+    }
+    set_option(socket, boost::asio::socket_base::keep_alive(true), "SO_KEEPALIVE");
+    if (options.keep_alive_idle.count() > 0) {
+#if defined(TCP_KEEPIDLE)
+        set_option(socket, IntOption<IPPROTO_TCP, TCP_KEEPIDLE>(static_cast<int>(options.keep_alive_idle.count())), "TCP_KEEPIDLE");
+#elif defined(TCP_KEEPALIVE)
+        set_option(socket, IntOption<IPPROTO_TCP, TCP_KEEPALIVE>(static_cast<int>(options.keep_alive_idle.count())), "TCP_KEEPALIVE");
+#endif
+    }
+#ifdef TCP_KEEPINTVL
+    if (options.keep_alive_interval.count() > 0) {
+        set_option(socket, IntOption<IPPROTO_TCP, TCP_KEEPINTVL>(static_cast<int>(options.keep_alive_interval.count())), "TCP_KEEPINTVL");
     }
-    return std::make_shared<SockIOStream>(std::move(ios));
+#endif
+#ifdef TCP_KEEPCNT
+    if (options.keep_alive_count > 0) {
+        set_option(socket, IntOption<IPPROTO_TCP, TCP_KEEPCNT>(options.keep_alive_count), "TCP_KEEPCNT");
+    }
+#endif
 }
-
-SockIOStream::SockIOStream(boost::asio::ip::tcp::iostream&& ios)
-    : ios_(std::move(ios))
-{
 }
 
-SockIOStream::~SockIOStream()
+ServerSockIOFactory::ServerSockIOFactory(const std::string& address, unsigned short port, const SockOptions& options)
+    : BasicServerSockIOFactory(options)
 {
-    release();
-}
+    LogFunc << VAR(address) << VAR(port);
 
-bool SockIOStream::write(std::string_view data)
-{
-    if (!ios_.good()) {
-        LogError << "ios is not good";
-        return false;
-    }
+    using namespace boost::asio::ip;
 
-    ios_ << data << std::endl;
-    return true;
+    tcp::endpoint endpoint(address::from_string(address), port);
+
+    server_acceptor_.open(endpoint.protocol());
+    server_acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    // before listen(), so the window scale of accepted connections fits the receive buffer
+    set_buffer_options(server_acceptor_, options_);
+    server_acceptor_.bind(endpoint);
+
+    server_acceptor_.listen();
 }
 
-bool SockIOStream::release()
+uint16_t ServerSockIOFactory::port() const
 {
-    ios_.close();
-    return true;
+    return server_acceptor_.local_endpoint().port();
 }
 
-bool SockIOStream::is_open() const
+ClientSockIOFactory::ClientSockIOFactory(const std::string& address, unsigned short port, const SockOptions& options)
+    : BasicClientSockIOFactory(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(address), port), options)
 {
-    return !ios_.eof();
+    LogFunc << VAR(address) << VAR(port);
 }
 
-void SockIOStream::expires_after(duration_t timeout)
+SockIOStream::SockIOStream(boost::asio::ip::tcp::iostream&& ios, const SockOptions& options)
+    : BasicSockIOStream(std::move(ios))
+    , quick_ack_(options.quick_ack)
 {
-    ios_.expires_after(timeout);
+    set_stream_options(socket(), options);
+    after_read();
 }
 
-std::string SockIOStream::read_once(size_t max_count)
+void SockIOStream::after_read()
 {
-    constexpr size_t kBufferSize = 128 * 1024;
-
-    if (!buffer_) {
-        buffer_ = std::make_unique<char[]>(kBufferSize);
+    // the kernel drops TCP_QUICKACK on its own, it is re-armed after every read
+#ifdef TCP_QUICKACK
+    if (!quick_ack_) {
+        return;
     }
-
-    size_t count = std::min(kBufferSize, max_count);
-    auto read = ios_.read(buffer_.get(), count).gcount();
-    return std::string(buffer_.get(), read);
+    // not logged, it would repeat on every read
+    boost::system::error_code ec;
+    socket().set_option(IntOption<IPPROTO_TCP, TCP_QUICKACK>(1), ec);
+#endif
 }
 
 MAA_NS_END
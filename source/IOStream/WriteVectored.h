@@ -0,0 +1,137 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <limits.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "MaaUtils/Conf.h"
+#include "MaaUtils/Time.hpp"
+
+MAA_NS_BEGIN
+
+namespace vectored_detail
+{
+// `write_some(iov, count)` behaves like writev
+template <typename write_some_t>
+inline bool write_all(
+    int fd,
+    std::span<const std::string_view> messages,
+    bool newline,
+    std::chrono::milliseconds timeout,
+    write_some_t write_some)
+{
+    auto start_time = std::chrono::steady_clock::now();
+
+    static constexpr char kNewline = '\n';
+
+    std::vector<iovec> iov;
+    iov.reserve(messages.size() * (newline ? 2 : 1));
+    for (const auto& msg : messages) {
+        if (!msg.empty()) {
+            iov.push_back({ const_cast<char*>(msg.data()), msg.size() });
+        }
+        if (newline) {
+            iov.push_back({ const_cast<char*>(&kNewline), 1 });
+        }
+    }
+
+    size_t pos = 0;
+    while (pos < iov.size()) {
+        int count = static_cast<int>(std::min<size_t>(iov.size() - pos, IOV_MAX));
+        ssize_t written = write_some(iov.data() + pos, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return false;
+            }
+
+            int wait_ms = -1;
+            if (timeout != std::chrono::milliseconds::max()) {
+                auto remaining = timeout - duration_since(start_time);
+                if (remaining <= std::chrono::milliseconds(0)) {
+                    errno = ETIMEDOUT;
+                    return false;
+                }
+                wait_ms = static_cast<int>(std::min<std::chrono::milliseconds::rep>(remaining.count(), std::numeric_limits<int>::max()));
+            }
+
+            // the caller reports the write's errno, not the poll's
+            const int write_errno = errno;
+            pollfd pfd { .fd = fd, .events = POLLOUT, .revents = 0 };
+            int ret = ::poll(&pfd, 1, wait_ms);
+            if (ret == 0) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+            if (ret < 0 && errno != EINTR) {
+                errno = write_errno;
+                return false;
+            }
+            continue;
+        }
+
+        // skip the fully written entries, then trim the partially written one
+        auto left = static_cast<size_t>(written);
+        while (pos < iov.size() && left >= iov[pos].iov_len) {
+            left -= iov[pos].iov_len;
+            ++pos;
+        }
+        if (left > 0) {
+            iov[pos].iov_base = static_cast<char*>(iov[pos].iov_base) + left;
+            iov[pos].iov_len -= left;
+        }
+    }
+    return true;
+}
+}
+
+// Writes every message, each followed by a newline if asked, with as few writev calls as the kernel allows.
+// Works on blocking and non-blocking fds alike. For pipes, sockets go through send_vectored().
+// A non-blocking fd that stays full for `timeout` fails with ETIMEDOUT, part of the data may be written by then.
+inline bool write_vectored(
+    int fd,
+    std::span<const std::string_view> messages,
+    bool newline,
+    std::chrono::milliseconds timeout = std::chrono::milliseconds::max())
+{
+    return vectored_detail::write_all(fd, messages, newline, timeout, [fd](iovec* iov, int count) { return ::writev(fd, iov, count); });
+}
+
+// write_vectored() for sockets: a peer that has gone away yields EPIPE instead of a process-killing SIGPIPE.
+// Without MSG_NOSIGNAL (macOS) asio has already set SO_NOSIGPIPE on the sockets it opens.
+inline bool send_vectored(
+    int fd,
+    std::span<const std::string_view> messages,
+    bool newline,
+    std::chrono::milliseconds timeout = std::chrono::milliseconds::max())
+{
+#ifdef MSG_NOSIGNAL
+    constexpr int kFlags = MSG_NOSIGNAL;
+#else
+    constexpr int kFlags = 0;
+#endif
+
+    return vectored_detail::write_all(fd, messages, newline, timeout, [fd](iovec* iov, int count) {
+        msghdr msg {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        return ::sendmsg(fd, &msg, kFlags);
+    });
+}
+
+MAA_NS_END
+
+#endif
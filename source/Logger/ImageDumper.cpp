@@ -0,0 +1,279 @@
+#include "ImageDumper.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <utility>
+
+#include "MaaUtils/ImageIo.h"
+#include "MaaUtils/Platform.h"
+#include "MaaUtils/Time.hpp"
+
+MAA_LOG_NS_BEGIN
+
+ImageDumper::~ImageDumper()
+{
+    stop();
+}
+
+void ImageDumper::set_options(ImageDumpOptions options)
+{
+    // the worker count may change, restart them on the next dump
+    stop();
+
+    std::unique_lock lock(mutex_);
+    options_ = std::move(options);
+    enforce_budget();
+}
+
+void ImageDumper::drain()
+{
+    std::unique_lock lock(mutex_);
+    drained_cond_.wait(lock, [&]() { return jobs_.empty() && writing_ == 0; });
+}
+
+void ImageDumper::reset(std::filesystem::path dir)
+{
+    std::unique_lock lock(mutex_);
+    // queued jobs point into the old directory
+    drained_cond_.wait(lock, [&]() { return jobs_.empty() && writing_ == 0; });
+
+    dir_ = std::move(dir);
+    dumped_.clear();
+    files_.clear();
+    total_bytes_ = 0;
+
+    std::error_code ec;
+    if (dir_.empty() || !std::filesystem::exists(dir_, ec)) {
+        return;
+    }
+
+    // count dumps left by earlier runs against the budget, oldest first
+    std::vector<std::pair<std::filesystem::file_time_type, DumpedFile>> existing;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+        if (!entry.is_regular_file(ec)) {
+            continue;
+        }
+        existing.emplace_back(entry.last_write_time(ec), DumpedFile { .path = entry.path(), .size = entry.file_size(ec) });
+    }
+    std::ranges::sort(existing, {}, &decltype(existing)::value_type::first);
+
+    for (auto& [_, file] : existing) {
+        total_bytes_ += file.size;
+        files_.emplace_back(std::move(file));
+    }
+    enforce_budget();
+}
+
+void ImageDumper::stop()
+{
+    {
+        std::unique_lock lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    cond_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+}
+
+std::string ImageDumper::dump(const cv::Mat& image)
+{
+    uint64_t hash = content_hash(image);
+
+    std::unique_lock lock(mutex_);
+
+    if (!failures_.empty()) {
+        auto failures = std::exchange(failures_, {});
+        lock.unlock();
+        for (const auto& failure : failures) {
+            LogError << "failed to dump image" << VAR(failure.path) << VAR(failure.what);
+        }
+        lock.lock();
+    }
+
+    if (dir_.empty()) {
+        return "Not logging";
+    }
+    if (auto it = dumped_.find(hash); it != dumped_.end()) {
+        return path_to_utf8_string(it->second);
+    }
+    if (jobs_.size() >= options_.max_pending) {
+        return "Dump queue is full";
+    }
+
+    auto filepath = dir_ / path(std::format("{}-{:016x}{}", format_now_for_filename(), hash, options_.extension));
+    dumped_.emplace(hash, filepath);
+    // the caller keeps ownership of its pixels, only the copy outlives this call
+    jobs_.emplace_back(Job { .image = image.clone(), .path = filepath, .hash = hash });
+
+    if (!running_) {
+        start_workers();
+    }
+
+    lock.unlock();
+    cond_.notify_one();
+
+    return path_to_utf8_string(filepath);
+}
+
+uint64_t ImageDumper::content_hash(const cv::Mat& image)
+{
+    // FNV-1a over 64-bit words in four independent lanes, far cheaper than encoding the image
+    constexpr uint64_t kPrime = 0x100000001b3ULL;
+    constexpr uint64_t kOffset = 0xcbf29ce484222325ULL;
+
+    uint64_t lanes[4] = { kOffset, kOffset ^ 1, kOffset ^ 2, kOffset ^ 3 };
+    auto mix = [&](size_t lane, uint64_t value) {
+        lanes[lane] = (lanes[lane] ^ value) * kPrime;
+    };
+
+    mix(0, static_cast<uint64_t>(image.rows));
+    mix(1, static_cast<uint64_t>(image.cols));
+    mix(2, static_cast<uint64_t>(image.type()));
+
+    const size_t row_bytes = static_cast<size_t>(image.cols) * image.elemSize();
+    for (int r = 0; r < image.rows; ++r) {
+        const auto* data = image.ptr(r);
+
+        size_t i = 0;
+        for (; i + 32 <= row_bytes; i += 32) {
+            uint64_t words[4] = {};
+            std::memcpy(words, data + i, sizeof(words));
+            mix(0, words[0]);
+            mix(1, words[1]);
+            mix(2, words[2]);
+            mix(3, words[3]);
+        }
+        for (; i < row_bytes; i += 8) {
+            uint64_t word = 0;
+            std::memcpy(&word, data + i, std::min<size_t>(8, row_bytes - i));
+            mix(3, word);
+        }
+    }
+
+    uint64_t hash = kOffset;
+    for (uint64_t lane : lanes) {
+        hash = (hash ^ lane) * kPrime;
+    }
+    return hash ^ (hash >> 32);
+}
+
+std::vector<int> ImageDumper::encode_params() const
+{
+    if (options_.quality < 0) {
+        return {};
+    }
+
+    std::string ext = options_.extension;
+    std::ranges::transform(ext, ext.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+
+    if (ext == ".png") {
+        return { cv::IMWRITE_PNG_COMPRESSION, options_.quality };
+    }
+    if (ext == ".jpg" || ext == ".jpeg") {
+        return { cv::IMWRITE_JPEG_QUALITY, options_.quality };
+    }
+    if (ext == ".webp") {
+        return { cv::IMWRITE_WEBP_QUALITY, options_.quality };
+    }
+    return {};
+}
+
+void ImageDumper::start_workers()
+{
+    running_ = true;
+
+    size_t count = std::max<size_t>(options_.workers, 1);
+    for (size_t i = 0; i < count; ++i) {
+        workers_.emplace_back(&ImageDumper::worker_loop, this);
+    }
+}
+
+void ImageDumper::worker_loop()
+{
+    while (true) {
+        std::unique_lock lock(mutex_);
+        cond_.wait(lock, [&]() { return !jobs_.empty() || !running_; });
+
+        // drain what is queued before stopping
+        if (jobs_.empty()) {
+            return;
+        }
+
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+        ++writing_;
+        lock.unlock();
+
+        write(std::move(job));
+    }
+}
+
+void ImageDumper::write(Job job)
+{
+    std::vector<int> params;
+    {
+        std::unique_lock lock(mutex_);
+        params = encode_params();
+    }
+
+    bool ret = false;
+    std::string error;
+    try {
+        ret = MAA_NS::imwrite(job.path, job.image, params);
+    }
+    catch (const std::exception& e) {
+        // e.g. an extension without codec, a depth the codec rejects or a read-only directory
+        error = e.what();
+    }
+
+    std::error_code ec;
+    uintmax_t size = ret ? std::filesystem::file_size(job.path, ec) : 0;
+
+    std::unique_lock lock(mutex_);
+
+    if (ret) {
+        total_bytes_ += size;
+        files_.emplace_back(DumpedFile { .path = std::move(job.path), .size = size, .hash = job.hash });
+        enforce_budget();
+    }
+    else {
+        if (auto it = dumped_.find(job.hash); it != dumped_.end() && it->second == job.path) {
+            dumped_.erase(it);
+        }
+        if (!error.empty()) {
+            failures_.emplace_back(Failure { .path = std::move(job.path), .what = std::move(error) });
+        }
+    }
+
+    if (--writing_ == 0 && jobs_.empty()) {
+        drained_cond_.notify_all();
+    }
+}
+
+void ImageDumper::enforce_budget()
+{
+    // keep at least the newest dump
+    while (total_bytes_ > options_.max_bytes && files_.size() > 1) {
+        DumpedFile file = std::move(files_.front());
+        files_.pop_front();
+
+        std::error_code ec;
+        std::filesystem::remove(file.path, ec);
+        total_bytes_ -= std::min(total_bytes_, file.size);
+
+        if (auto it = dumped_.find(file.hash); it != dumped_.end() && it->second == file.path) {
+            dumped_.erase(it);
+        }
+    }
+}
+
+MAA_LOG_NS_END
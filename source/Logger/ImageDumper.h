@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "MaaUtils/Conf.h"
+#include "MaaUtils/Logger.h"
+#include "MaaUtils/NoWarningCVMat.hpp"
+#include "MaaUtils/NonCopyable.hpp"
+
+MAA_LOG_NS_BEGIN
+
+// Encodes dumped images on background threads. The caller hashes the pixels and queues a copy of them,
+// so the image may be modified or released right after logging it.
+class ImageDumper : public NonCopyable
+{
+public:
+    ImageDumper() = default;
+    ~ImageDumper();
+
+    void set_options(ImageDumpOptions options);
+    // wait until every queued dump is written, e.g. before the directory is rotated
+    void drain();
+    // forget what was dumped, e.g. after the directory is rotated
+    void reset(std::filesystem::path dir);
+    void stop();
+
+    // returns the path the image will be written to, or a short reason why it is not dumped
+    std::string dump(const cv::Mat& image);
+
+private:
+    struct Job
+    {
+        cv::Mat image;
+        std::filesystem::path path;
+        uint64_t hash = 0;
+    };
+
+    struct Failure
+    {
+        std::filesystem::path path;
+        std::string what;
+    };
+
+    struct DumpedFile
+    {
+        std::filesystem::path path;
+        uintmax_t size = 0;
+        uint64_t hash = 0;
+    };
+
+    static uint64_t content_hash(const cv::Mat& image);
+    std::vector<int> encode_params() const;
+
+    void start_workers();
+    void worker_loop();
+    void write(Job job);
+    void enforce_budget();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable drained_cond_;
+    std::deque<Job> jobs_;
+    // jobs taken by a worker and not written yet
+    size_t writing_ = 0;
+    // logged by the next dump(), a worker must not wait for the logger while drain() may hold it
+    std::vector<Failure> failures_;
+    std::vector<std::thread> workers_;
+    bool running_ = false;
+
+    ImageDumpOptions options_;
+    std::filesystem::path dir_;
+
+    // hash -> path of files written or queued in dir_
+    std::unordered_map<uint64_t, std::filesystem::path> dumped_;
+    // oldest first
+    std::deque<DumpedFile> files_;
+    uintmax_t total_bytes_ = 0;
+};
+
+MAA_LOG_NS_END
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <future>
+#include <memory>
+#include <string>
+
+#include "MaaUtils/Conf.h"
+#include "MaaUtils/LoggerUtils.h"
+#include "MaaUtils/NonCopyable.hpp"
+
+MAA_LOG_NS_BEGIN
+
+struct LogRecord
+{
+    level lv = level::off;
+    bool std_out = false;
+    bool to_file = false;
+    std::string text;
+    // binlog entry or JSON line written to the file instead of text
+    std::string structured;
+
+    // set for flush barriers instead of a real record
+    std::promise<void>* barrier = nullptr;
+};
+
+// Bounded MPMC ring buffer (Dmitry Vyukov's algorithm).
+// Producers never take a lock; the single writer thread is the usual consumer,
+// producers only pop to implement overflow_policy::drop_oldest.
+class LogQueue : public NonCopyable
+{
+public:
+    explicit LogQueue(size_t capacity)
+        : capacity_(std::bit_ceil(std::max<size_t>(capacity, 2)))
+        , mask_(capacity_ - 1)
+        , slots_(std::make_unique<Slot[]>(capacity_))
+    {
+        for (size_t i = 0; i < capacity_; ++i) {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // leaves `record` untouched on failure
+    bool try_push(LogRecord& record)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots_[pos & mask_];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.record = std::move(record);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(LogRecord& record)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots_[pos & mask_];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    record = std::move(slot.record);
+                    slot.seq.store(pos + capacity_, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq = 0;
+        LogRecord record;
+    };
+
+    const size_t capacity_ = 0;
+    const size_t mask_ = 0;
+    std::unique_ptr<Slot[]> slots_;
+
+    alignas(64) std::atomic<size_t> head_ = 0;
+    alignas(64) std::atomic<size_t> tail_ = 0;
+};
+
+MAA_LOG_NS_END
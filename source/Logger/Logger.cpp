@@ -11,10 +11,14 @@
 #include <sys/utsname.h>
 #endif
 
+#ifdef MAA_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "ImageDumper.h"
+#include "LogQueue.h"
 #include "MaaUtils/Encoding.h"
-#include "MaaUtils/ImageIo.h"
 #include "MaaUtils/Platform.h"
-#include "MaaUtils/Uuid.h"
 
 #pragma message("MaaUtils MAA_VERSION: " MAA_VERSION)
 
@@ -27,12 +31,14 @@ constexpr separator separator::newline("\n");
 constexpr separator separator::comma(",");
 
 static constexpr std::string_view kSplitLine = "-----------------------------";
+static constexpr size_t kMaxBatchRecords = 1024;
+static constexpr std::string_view kCompressedSuffix = ".gz";
 
-std::string LogStream::stdout_string()
+static std::string stdout_string(level lv, std::string_view text)
 {
     std::string color;
 
-    switch (lv_) {
+    switch (lv) {
     case level::fatal:
     case level::error:
         color = "\033[31m";
@@ -50,7 +56,148 @@ std::string LogStream::stdout_string()
         break;
     }
 
-    return color + utf8_to_crt(buffer_.str()) + "\033[0m";
+    return color + utf8_to_crt(text) + "\033[0m";
+}
+
+LogStream::~LogStream()
+{
+    if (binary_ || json_) {
+        // empty once moved from
+        if (!record_.empty()) {
+            if (binary_) {
+                binlog::finish_record(record_, 0);
+            }
+            else {
+                finish_json();
+            }
+            logger_.commit(lv_, stdout_, file_, std::move(buffer_), std::move(record_));
+        }
+        LogBufferPool::release(std::move(record_));
+        if (json_) {
+            LogBufferPool::release(std::move(message_));
+        }
+    }
+    else {
+        logger_.commit(lv_, stdout_, file_, std::move(buffer_));
+    }
+    LogBufferPool::release(std::move(buffer_));
+}
+
+void LogStream::begin_binary(std::span<const std::string_view> props, int pid, uint16_t tid)
+{
+    record_ = LogBufferPool::acquire();
+    binlog::begin_record(record_, binlog::record_kind::entry);
+    binlog::put_varint(record_, logger_.binary_site(props));
+    binlog::put_varint(record_, static_cast<uint64_t>(local_now_millis()));
+    binlog::put_varint(record_, static_cast<uint64_t>(pid));
+    binlog::put_varint(record_, tid);
+    binlog::put_u8(record_, static_cast<uint8_t>(lv_));
+    binlog::put_separator(record_, sep_.str);
+}
+
+void LogStream::begin_json(std::span<const std::string_view> props, int pid, uint16_t tid)
+{
+    record_ = LogBufferPool::acquire();
+    message_ = LogBufferPool::acquire();
+
+    std::format_to(
+        std::back_inserter(record_),
+        R"({{"time":"{}","level":"{}","pid":{},"tid":{})",
+        format_now_view(),
+        level_str(),
+        pid,
+        tid);
+
+    // LOG_ARGS, split into fields
+    int line = 0;
+    if (props.size() == 3 && props[1].starts_with('L')
+        && std::from_chars(props[1].data() + 1, props[1].data() + props[1].size(), line).ec == std::errc {}) {
+        record_.append(R"(,"file":")");
+        append_json_escaped(record_, props[0]);
+        std::format_to(std::back_inserter(record_), R"(","line":{},"function":")", line);
+        append_json_escaped(record_, props[2]);
+        record_.push_back('"');
+    }
+    else {
+        record_.append(R"(,"props":[)");
+        for (size_t i = 0; i < props.size(); ++i) {
+            record_.append(i == 0 ? "\"" : ",\"");
+            append_json_escaped(record_, props[i]);
+            record_.push_back('"');
+        }
+        record_.push_back(']');
+    }
+
+    record_.append(R"(,"vars":{)");
+}
+
+void LogStream::finish_json()
+{
+    while (!message_.empty() && message_.back() == ' ') {
+        message_.pop_back();
+    }
+    record_.append(R"(},"message":")");
+    record_.append(message_);
+    record_.append("\"}\n");
+}
+
+namespace
+{
+struct ThreadBufferPool
+{
+    static constexpr size_t kMaxPooled = 8;
+    static constexpr size_t kInitCapacity = 256;
+    static constexpr size_t kMaxCapacity = 64 * 1024;
+
+    ThreadBufferPool() { destroyed = false; }
+
+    ~ThreadBufferPool() { destroyed = true; }
+
+    std::vector<std::string> buffers;
+
+    // LogStreams created in other thread_local destructors may outlive the pool
+    static thread_local bool destroyed;
+};
+
+thread_local bool ThreadBufferPool::destroyed = false;
+
+ThreadBufferPool* thread_buffer_pool()
+{
+    if (ThreadBufferPool::destroyed) {
+        return nullptr;
+    }
+    thread_local ThreadBufferPool pool;
+    return &pool;
+}
+}
+
+std::string LogBufferPool::acquire()
+{
+    auto* pool = thread_buffer_pool();
+    if (!pool || pool->buffers.empty()) {
+        std::string buffer;
+        buffer.reserve(ThreadBufferPool::kInitCapacity);
+        return buffer;
+    }
+
+    std::string buffer = std::move(pool->buffers.back());
+    pool->buffers.pop_back();
+    return buffer;
+}
+
+void LogBufferPool::release(std::string&& buffer)
+{
+    // buffers moved into the async queue come back without capacity, keeping them would only displace useful ones
+    if (buffer.capacity() < ThreadBufferPool::kInitCapacity || buffer.capacity() > ThreadBufferPool::kMaxCapacity) {
+        return;
+    }
+    auto* pool = thread_buffer_pool();
+    if (!pool || pool->buffers.size() >= ThreadBufferPool::kMaxPooled) {
+        return;
+    }
+
+    buffer.clear();
+    pool->buffers.emplace_back(std::move(buffer));
 }
 
 std::string_view LogStream::level_str()
@@ -80,6 +227,11 @@ Logger& Logger::get_instance()
     return unique_instance;
 }
 
+Logger::~Logger()
+{
+    close();
+}
+
 void Logger::start_logging(std::filesystem::path dir)
 {
     log_dir_ = std::move(dir);
@@ -88,10 +240,11 @@ void Logger::start_logging(std::filesystem::path dir)
         dumps_dir_.clear();
     }
     else {
-        log_path_ = log_dir_ / kLogFilename;
+        log_path_ = file_path();
         dumps_dir_ = log_dir_ / kDumpsDirname;
     }
     reinit();
+    dumper().reset(dumps_dir_);
 }
 
 void Logger::set_stdout_level(level lv)
@@ -99,45 +252,189 @@ void Logger::set_stdout_level(level lv)
     stdout_level_ = lv;
 }
 
+void Logger::set_file_level(level lv)
+{
+    file_level_ = lv;
+}
+
+void Logger::set_file_format(log_format format)
+{
+    if (format == file_format_) {
+        return;
+    }
+
+    // records already formatted for the old file must land in it
+    flush();
+
+    std::unique_lock trace_lock(trace_mutex_);
+    file_format_ = format;
+    if (!log_dir_.empty()) {
+        log_path_ = file_path();
+        open(true);
+    }
+}
+
+void Logger::set_async(bool async, size_t queue_capacity)
+{
+    if (async == async_) {
+        return;
+    }
+
+    if (async) {
+        if (!queue_ || queue_->capacity() < queue_capacity) {
+            queue_ = std::make_unique<LogQueue>(queue_capacity);
+        }
+        start_writer();
+        async_ = true;
+    }
+    else {
+        async_ = false;
+        // a producer that saw async_ before the store may still be pushing
+        for (size_t producers = producers_.load(); producers > 0; producers = producers_.load()) {
+            producers_.wait(producers);
+        }
+        // the writer empties the queue before it exits
+        stop_writer();
+    }
+}
+
+void Logger::set_overflow_policy(overflow_policy policy)
+{
+    overflow_policy_ = policy;
+}
+
+void Logger::set_dump_options(ImageDumpOptions options)
+{
+    dumper().set_options(std::move(options));
+}
+
 void Logger::flush()
 {
-    bool rotated = rotate();
-    open(!rotated);
+    report_limiters();
+
+    if (writer_running_) {
+        std::promise<void> barrier;
+        auto done = barrier.get_future();
+
+        LogRecord record;
+        record.barrier = &barrier;
+        if (try_enqueue(record)) {
+            done.wait();
+        }
+
+        if (size_t dropped = dropped_.exchange(0)) {
+            internal_dbg() << "Dropped" << dropped << "logs, queue is full";
+        }
+    }
+
+    std::unique_lock trace_lock(trace_mutex_);
+    ofs_.flush();
+    if (bytes_written_ >= rotation_.max_size) {
+        rotate();
+    }
+}
 
-    if (rotated) {
-        log_proc_info();
+void Logger::set_rotation_options(LogRotationOptions options)
+{
+#ifndef MAA_WITH_ZLIB
+    if (options.compress) {
+        LogWarn << "built without zlib, rotated logs stay uncompressed";
+        options.compress = false;
     }
+#endif
+
+    std::unique_lock trace_lock(trace_mutex_);
+    rotation_ = std::move(options);
 }
 
 void Logger::reinit()
 {
-    bool rotated = rotate();
-    open(!rotated);
+    {
+        std::unique_lock trace_lock(trace_mutex_);
+        open(true);
+        if (bytes_written_ >= rotation_.max_size) {
+            rotate();
+        }
+    }
+
+    proc_info_pending_ = false;
     log_proc_info();
 }
 
-bool Logger::rotate()
+std::filesystem::path Logger::file_path() const
 {
-    if (log_path_.empty() || !std::filesystem::exists(log_path_)) {
-        return false;
+    switch (file_format_) {
+    case log_format::binary:
+        return log_dir_ / kBinlogFilename;
+    case log_format::json_lines:
+        return log_dir_ / kJsonlFilename;
+    case log_format::text:
+    default:
+        return log_dir_ / kLogFilename;
     }
+}
 
-    std::unique_lock trace_lock(trace_mutex_);
-    if (ofs_.is_open()) {
-        ofs_.close();
+std::filesystem::path Logger::backup_path(size_t generation) const
+{
+    // maa.log -> maa.bak.log, maa.bak.2.log; maa.jsonl -> maa.bak.jsonl, maa.bak.2.jsonl
+    std::string stem = path_to_utf8_string(log_path_.stem());
+    std::string ext = path_to_utf8_string(log_path_.extension());
+    if (generation <= 1) {
+        return log_dir_ / path(std::format("{}.bak{}", stem, ext));
     }
+    return log_dir_ / path(std::format("{}.bak.{}{}", stem, generation, ext));
+}
 
-    constexpr uintmax_t MaxLogSize = 16ULL * 1024 * 1024;
-    const uintmax_t log_size = std::filesystem::file_size(log_path_);
-    if (log_size < MaxLogSize) {
-        return false;
+void Logger::rotate()
+{
+    if (log_path_.empty()) {
+        return;
+    }
+
+    // The compressor still reads the previous generation and the renames below would pull it away.
+    // Waiting here would stall every logging thread behind trace_mutex_, so the file grows a little
+    // past max_size instead and the next write tries again.
+    if (compress_future_.valid() && compress_future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+
+    if (ofs_.is_open()) {
+        ofs_.close();
     }
 
     std::error_code ec;
 
-    const std::filesystem::path bak_path = log_dir_ / kLogbakFilename;
-    std::filesystem::copy(log_path_, bak_path, std::filesystem::copy_options::overwrite_existing, ec);
+    // maa.bak.log -> maa.bak.2.log -> ... -> dropped, rename only, never copy
+    const size_t generations = rotation_.generations;
+    for (size_t gen = generations; gen >= 1; --gen) {
+        for (std::string_view suffix : { std::string_view(), kCompressedSuffix }) {
+            auto src = backup_path(gen);
+            src += suffix;
+            if (!std::filesystem::exists(src, ec)) {
+                continue;
+            }
+            if (gen == generations) {
+                std::filesystem::remove(src, ec);
+            }
+            else {
+                auto dst = backup_path(gen + 1);
+                dst += suffix;
+                std::filesystem::rename(src, dst, ec);
+            }
+        }
+    }
 
+    if (generations == 0) {
+        std::filesystem::remove(log_path_, ec);
+    }
+    else {
+        std::filesystem::rename(log_path_, backup_path(1), ec);
+    }
+
+    // dumps still queued belong to the directory about to be moved
+    if (dumper_) {
+        dumper_->drain();
+    }
     const std::filesystem::path dumps_bak_path = log_dir_ / kDumpsbakDirname;
     if (std::filesystem::exists(dumps_bak_path)) {
         std::filesystem::remove_all(dumps_bak_path, ec);
@@ -145,9 +442,72 @@ bool Logger::rotate()
     if (std::filesystem::exists(dumps_dir_)) {
         std::filesystem::rename(dumps_dir_, dumps_bak_path, ec);
     }
+    if (dumper_) {
+        dumper_->reset(dumps_dir_);
+    }
 
-    return true;
+    open(false);
+
+    if (rotation_.compress && generations > 0) {
+        compress_future_ = std::async(std::launch::async, compress_file, backup_path(1));
+    }
+
+    // written by the next log statement, not while holding trace_mutex_
+    proc_info_pending_ = true;
+}
+
+#ifdef MAA_WITH_ZLIB
+void Logger::compress_file(std::filesystem::path file)
+{
+    auto gz_path = file;
+    gz_path += kCompressedSuffix;
+    auto tmp_path = gz_path;
+    tmp_path += ".tmp";
+
+    std::ifstream ifs(file, std::ios::in | std::ios::binary);
+    if (!ifs.is_open()) {
+        return;
+    }
+
+#ifdef _WIN32
+    gzFile gz = gzopen_w(tmp_path.c_str(), "wb");
+#else
+    gzFile gz = gzopen(tmp_path.c_str(), "wb");
+#endif
+    if (!gz) {
+        return;
+    }
+
+    constexpr size_t kChunkSize = 1024 * 1024;
+    auto chunk = std::make_unique<char[]>(kChunkSize);
+    bool ok = true;
+    while (ok && ifs) {
+        ifs.read(chunk.get(), kChunkSize);
+        auto count = static_cast<unsigned>(ifs.gcount());
+        if (count > 0) {
+            ok = gzwrite(gz, chunk.get(), count) == static_cast<int>(count);
+        }
+    }
+    ok = gzclose(gz) == Z_OK && ok;
+    ifs.close();
+
+    std::error_code ec;
+    if (!ok) {
+        std::filesystem::remove(tmp_path, ec);
+        return;
+    }
+    std::filesystem::rename(tmp_path, gz_path, ec);
+    if (!ec) {
+        std::filesystem::remove(file, ec);
+    }
 }
+#else
+void Logger::compress_file(std::filesystem::path file)
+{
+    // never started, set_rotation_options turns `compress` off in builds without zlib
+    std::ignore = file;
+}
+#endif
 
 void Logger::open(bool append)
 {
@@ -156,7 +516,6 @@ void Logger::open(bool append)
     }
     std::filesystem::create_directories(log_dir_);
 
-    std::unique_lock trace_lock(trace_mutex_);
     if (ofs_.is_open()) {
         ofs_.close();
     }
@@ -165,27 +524,138 @@ void Logger::open(bool append)
 
     // https://stackoverflow.com/questions/55513974/controlling-inheritability-of-file-handles-created-by-c-stdfstream-in-window
     std::string str_log_path = log_path_.string();
-    FILE* file_ptr = fopen(str_log_path.c_str(), append ? "a" : "w");
+    const bool binary = file_format_ == log_format::binary;
+    FILE* file_ptr = fopen(str_log_path.c_str(), append ? (binary ? "ab" : "a") : (binary ? "wb" : "w"));
     SetHandleInformation((HANDLE)_get_osfhandle(_fileno(file_ptr)), HANDLE_FLAG_INHERIT, 0);
     ofs_ = std::ofstream(file_ptr);
 
 #else
 
-    ofs_ = std::ofstream(log_path_, std::ios::out | (append ? std::ios::app : std::ios::trunc));
+    auto mode = std::ios::out | (append ? std::ios::app : std::ios::trunc);
+    if (file_format_ == log_format::binary) {
+        mode |= std::ios::binary;
+    }
+    ofs_ = std::ofstream(log_path_, mode);
 
 #endif
+
+    // the only stat, from here on the size is counted as it is written
+    std::error_code ec;
+    bytes_written_ = append ? std::filesystem::file_size(log_path_, ec) : 0;
+    if (ec) {
+        bytes_written_ = 0;
+    }
+
+    if (file_format_ == log_format::binary) {
+        if (bytes_written_ == 0) {
+            write_binary_header();
+        }
+        // every file carries the full site table, it may be decoded without its predecessors
+        for (size_t id = 0; id < binary_sites_.size(); ++id) {
+            write_binary_site(static_cast<uint32_t>(id));
+        }
+    }
+}
+
+void Logger::write_binary_header()
+{
+    std::string header(binlog::kMagic);
+    binlog::put_u32(header, binlog::kVersion);
+    ofs_.write(header.data(), header.size());
+    bytes_written_ += header.size();
+}
+
+void Logger::write_binary_site(uint32_t id)
+{
+    if (!ofs_.is_open()) {
+        return;
+    }
+
+    const std::string& key = binary_sites_[id];
+
+    std::string record;
+    size_t pos = binlog::begin_record(record, binlog::record_kind::site);
+    binlog::put_varint(record, id);
+    binlog::put_varint(record, static_cast<uint64_t>(std::ranges::count(key, '\0')));
+    for (size_t begin = 0, end = key.find('\0'); end != std::string::npos; begin = end + 1, end = key.find('\0', begin)) {
+        binlog::put_bytes(record, std::string_view(key).substr(begin, end - begin));
+    }
+    binlog::finish_record(record, pos);
+
+    ofs_.write(record.data(), record.size());
+    bytes_written_ += record.size();
+}
+
+namespace
+{
+// call site ids this thread has seen, so only the first statement of a site takes trace_mutex_
+struct ThreadSiteCache
+{
+    ThreadSiteCache() { destroyed = false; }
+
+    ~ThreadSiteCache() { destroyed = true; }
+
+    std::string key;
+    std::unordered_map<std::string, uint32_t> ids;
+
+    static thread_local bool destroyed;
+};
+
+thread_local bool ThreadSiteCache::destroyed = false;
+}
+
+uint32_t Logger::binary_site(std::span<const std::string_view> props)
+{
+    thread_local ThreadSiteCache cache;
+
+    std::string local_key;
+    std::string& key = ThreadSiteCache::destroyed ? local_key : cache.key;
+    key.clear();
+    for (auto prop : props) {
+        key.append(prop).push_back('\0');
+    }
+
+    if (!ThreadSiteCache::destroyed) {
+        if (auto it = cache.ids.find(key); it != cache.ids.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock trace_lock(trace_mutex_);
+    auto [it, inserted] = binary_site_ids_.try_emplace(key, static_cast<uint32_t>(binary_sites_.size()));
+    if (inserted) {
+        binary_sites_.emplace_back(key);
+        // written right away, so it precedes every entry using the id
+        if (file_format_ == log_format::binary) {
+            write_binary_site(it->second);
+        }
+    }
+    if (!ThreadSiteCache::destroyed) {
+        cache.ids.emplace(key, it->second);
+    }
+    return it->second;
 }
 
 void Logger::close()
 {
+    report_limiters();
+
     internal_dbg() << kSplitLine;
     internal_dbg() << "Close log";
     internal_dbg() << kSplitLine;
 
+    set_async(false);
+    if (dumper_) {
+        dumper_->stop();
+    }
+
     std::unique_lock trace_lock(trace_mutex_);
     if (ofs_.is_open()) {
         ofs_.close();
     }
+    if (compress_future_.valid()) {
+        compress_future_.wait();
+    }
 }
 
 static std::string sys_info()
@@ -227,21 +697,261 @@ void Logger::log_proc_info()
     internal_dbg() << kSplitLine;
 }
 
-void Logger::count_and_check_flush()
+void Logger::commit(level lv, bool std_out, bool to_file, std::string&& text, std::string&& structured)
 {
-    static constexpr size_t kMaxCount = 1'000'000;
+    if (!std_out && !to_file) {
+        return;
+    }
+
+    if (async_.load(std::memory_order_acquire)) {
+        LogRecord record;
+        record.lv = lv;
+        record.std_out = std_out;
+        record.to_file = to_file;
+        record.text = std::move(text);
+        record.structured = std::move(structured);
+        if (try_enqueue(record)) {
+            return;
+        }
+        // async mode just ended, fall back to writing in place
+        text = std::move(record.text);
+        structured = std::move(record.structured);
+    }
 
-    if (++log_count_ < kMaxCount) {
+    write_in_place(lv, std_out, to_file, text, structured);
+}
+
+void Logger::commit(level lv, bool std_out, bool to_file, std::string_view text, std::string_view structured)
+{
+    if (!std_out && !to_file) {
         return;
     }
 
-    log_count_ = 0;
+    if (async_.load(std::memory_order_acquire)) {
+        commit(lv, std_out, to_file, std::string(text), std::string(structured));
+        return;
+    }
 
-    internal_dbg() << kSplitLine;
-    internal_dbg() << "Too many logs, flushing...";
-    internal_dbg() << kSplitLine;
+    write_in_place(lv, std_out, to_file, text, structured);
+}
 
-    flush();
+void Logger::write_in_place(level lv, bool std_out, bool to_file, std::string_view text, std::string_view structured)
+{
+    std::unique_lock trace_lock(trace_mutex_);
+
+    if (std_out) {
+        std::cout << stdout_string(lv, text) << std::endl;
+    }
+    if (to_file) {
+        if (structured.empty()) {
+            ofs_ << text << std::endl;
+            bytes_written_ += text.size() + 1;
+        }
+        else {
+            ofs_.write(structured.data(), structured.size());
+            ofs_.flush();
+            bytes_written_ += structured.size();
+        }
+        if (bytes_written_ >= rotation_.max_size) {
+            rotate();
+        }
+    }
+}
+
+bool Logger::try_enqueue(LogRecord& record)
+{
+    // seq_cst on both sides: either set_async(false) sees this producer, or this producer sees async_ cleared
+    producers_.fetch_add(1);
+    bool queued = async_.load() && enqueue(record);
+    if (producers_.fetch_sub(1) == 1) {
+        producers_.notify_all();
+    }
+    return queued;
+}
+
+bool Logger::enqueue(LogRecord& record)
+{
+    // flush barriers are never dropped
+    auto policy = record.barrier ? overflow_policy::block : overflow_policy_.load(std::memory_order_relaxed);
+
+    bool queued = true;
+    switch (policy) {
+    case overflow_policy::drop_newest:
+        if (!queue_->try_push(record)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        break;
+
+    case overflow_policy::drop_oldest:
+        queued = push_dropping_oldest(record);
+        break;
+
+    case overflow_policy::block:
+    default:
+        queued = push_blocking(record);
+        break;
+    }
+
+    if (queued) {
+        wake_seq_.fetch_add(1, std::memory_order_release);
+        wake_seq_.notify_one();
+    }
+    return queued;
+}
+
+bool Logger::push_blocking(LogRecord& record)
+{
+    while (!queue_->try_push(record)) {
+        size_t seen = popped_.load(std::memory_order_acquire);
+        if (queue_->try_push(record)) {
+            break;
+        }
+        if (!writer_running_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        popped_.wait(seen, std::memory_order_acquire);
+    }
+    return true;
+}
+
+bool Logger::push_dropping_oldest(LogRecord& record)
+{
+    while (!queue_->try_push(record)) {
+        LogRecord oldest;
+        if (!queue_->try_pop(oldest)) {
+            continue;
+        }
+        popped_.fetch_add(1, std::memory_order_release);
+        popped_.notify_all();
+
+        if (!oldest.barrier) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        // The writer may still be writing the records popped before it, so resolving it here would let flush()
+        // return early. It goes back in, and this record waits for room as with `block` instead of evicting past it.
+        if (!push_blocking(oldest)) {
+            // only without a writer, which has written everything before the barrier
+            oldest.barrier->set_value();
+        }
+        return push_blocking(record);
+    }
+    return true;
+}
+
+void Logger::start_writer()
+{
+    if (writer_running_.exchange(true)) {
+        return;
+    }
+    writer_ = std::thread(&Logger::writer_loop, this);
+}
+
+void Logger::stop_writer()
+{
+    if (!writer_running_.exchange(false)) {
+        return;
+    }
+
+    wake_seq_.fetch_add(1, std::memory_order_release);
+    wake_seq_.notify_one();
+
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+void Logger::writer_loop()
+{
+    while (true) {
+        size_t seen = wake_seq_.load(std::memory_order_acquire);
+
+        if (write_queued() > 0) {
+            continue;
+        }
+        if (!writer_running_.load(std::memory_order_acquire)) {
+            break;
+        }
+        wake_seq_.wait(seen, std::memory_order_acquire);
+    }
+}
+
+size_t Logger::write_queued()
+{
+    if (!queue_) {
+        return 0;
+    }
+
+    std::string file_batch;
+    std::string stdout_batch;
+    std::vector<std::promise<void>*> barriers;
+
+    size_t count = 0;
+    LogRecord record;
+    while (count < kMaxBatchRecords && queue_->try_pop(record)) {
+        ++count;
+
+        if (record.barrier) {
+            barriers.emplace_back(std::exchange(record.barrier, nullptr));
+            continue;
+        }
+
+        if (record.to_file && !record.structured.empty()) {
+            file_batch.append(record.structured);
+        }
+        else if (record.to_file) {
+            file_batch.append(record.text).push_back('\n');
+        }
+        if (record.std_out) {
+            stdout_batch.append(stdout_string(record.lv, record.text)).push_back('\n');
+        }
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if (!file_batch.empty() || !stdout_batch.empty()) {
+        write_batch(file_batch, stdout_batch);
+    }
+
+    popped_.fetch_add(count, std::memory_order_release);
+    popped_.notify_all();
+
+    for (auto* barrier : barriers) {
+        barrier->set_value();
+    }
+
+    return count;
+}
+
+void Logger::write_batch(std::string_view file_batch, std::string_view stdout_batch)
+{
+    std::unique_lock trace_lock(trace_mutex_);
+
+    if (!stdout_batch.empty()) {
+        std::cout << stdout_batch << std::flush;
+    }
+    if (!file_batch.empty()) {
+        ofs_.write(file_batch.data(), file_batch.size());
+        ofs_.flush();
+        bytes_written_ += file_batch.size();
+        if (bytes_written_ >= rotation_.max_size) {
+            rotate();
+        }
+    }
+}
+
+std::string Logger::dump_image(const cv::Mat& image)
+{
+    return dumper().dump(image);
+}
+
+ImageDumper& Logger::dumper()
+{
+    std::call_once(dumper_once_, [&]() { dumper_ = std::make_unique<ImageDumper>(); });
+    return *dumper_;
 }
 
 LogStream Logger::internal_dbg()
@@ -249,6 +959,52 @@ LogStream Logger::internal_dbg()
     return debug("Logger");
 }
 
+void Logger::add_limiter(LogSiteLimiter* limiter)
+{
+    std::unique_lock lock(limiters_mutex_);
+    limiters_.emplace_back(limiter);
+}
+
+void Logger::remove_limiter(LogSiteLimiter* limiter)
+{
+    std::unique_lock lock(limiters_mutex_);
+    std::erase(limiters_, limiter);
+}
+
+void Logger::report_limiters()
+{
+    // held while reporting so a limiter is not destroyed under us
+    std::unique_lock lock(limiters_mutex_);
+    for (auto* limiter : limiters_) {
+        limiter->report();
+    }
+}
+
+LogSiteLimiter::LogSiteLimiter(level lv, std::string_view file, std::string_view line, std::string_view function)
+    : lv_(lv)
+    , file_(file)
+    , line_(line)
+    , function_(function)
+{
+    Logger::get_instance().add_limiter(this);
+}
+
+LogSiteLimiter::~LogSiteLimiter()
+{
+    Logger::get_instance().remove_limiter(this);
+    report();
+}
+
+void LogSiteLimiter::report()
+{
+    if (suppressed_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    if (size_t suppressed = suppressed_.exchange(0, std::memory_order_relaxed)) {
+        Logger::get_instance().stream(lv_, file_, line_, function_) << "suppressed" << suppressed << "messages";
+    }
+}
+
 std::string StringConverter::operator()(const std::filesystem::path& path) const
 {
     return path_to_utf8_string(path);
@@ -261,20 +1017,12 @@ std::string StringConverter::operator()(const std::wstring& wstr) const
 
 std::string StringConverter::operator()(const cv::Mat& image) const
 {
-    if (dumps_dir_.empty()) {
-        return "Not logging";
-    }
+    // "Not logging" comes from the dumper
     if (image.empty()) {
         return "Empty image";
     }
 
-    std::string filename = std::format("{}-{}.png", format_now_for_filename(), make_uuid());
-    auto filepath = dumps_dir_ / path(filename);
-    bool ret = MAA_NS::imwrite(filepath, image);
-    if (!ret) {
-        return "Failed to write image";
-    }
-    return this->operator()(filepath);
+    return Logger::get_instance().dump_image(image);
 }
 
 MAA_LOG_NS_END
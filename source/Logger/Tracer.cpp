@@ -0,0 +1,292 @@
+#include "MaaUtils/Tracer.h"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "MaaUtils/LoggerUtils.h"
+
+MAA_LOG_NS_BEGIN
+
+std::atomic_bool Tracer::enabled_ = false;
+
+namespace
+{
+struct TraceEvent
+{
+    std::string_view name;
+    int64_t ts_ns = 0;
+    char phase = 0;
+};
+
+struct TraceChunk
+{
+    static constexpr size_t kSize = 4096;
+
+    TraceEvent events[kSize];
+    std::unique_ptr<TraceChunk> next;
+};
+
+// Written by its own thread only. `size` is published with release after the event (and a new
+// chunk) is in place, so dump() can read the first `size` events from any thread without a lock.
+// Chunks are only freed by the owner while it holds the registry mutex.
+struct ThreadTrace
+{
+    uint16_t tid = 0;
+    std::unique_ptr<TraceChunk> head = std::make_unique<TraceChunk>();
+    TraceChunk* tail = head.get();
+    std::atomic_size_t size = 0;
+    std::atomic_size_t dropped = 0;
+    // the reset() generation the events belong to, guarded by the registry mutex
+    size_t generation = 0;
+};
+
+// the events of a thread that has exited, without the slack of its last chunk
+struct FinishedTrace
+{
+    uint16_t tid = 0;
+    std::vector<TraceEvent> events;
+    size_t dropped = 0;
+};
+
+struct TraceRegistry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadTrace>> threads;
+    std::vector<FinishedTrace> finished;
+    std::atomic_size_t generation = 0;
+    std::atomic_size_t max_events = Tracer::kDefaultMaxEvents;
+};
+
+TraceRegistry& registry()
+{
+    static TraceRegistry unique_registry;
+    return unique_registry;
+}
+
+template <typename func_t>
+void for_each_event(const ThreadTrace& trace, size_t size, func_t func)
+{
+    const TraceChunk* chunk = trace.head.get();
+    for (size_t i = 0; i < size; ++i) {
+        if (i > 0 && i % TraceChunk::kSize == 0) {
+            chunk = chunk->next.get();
+        }
+        func(chunk->events[i % TraceChunk::kSize]);
+    }
+}
+
+// requires the registry mutex
+void clear_trace(ThreadTrace& trace, size_t generation)
+{
+    trace.head->next.reset();
+    trace.tail = trace.head.get();
+    trace.size.store(0, std::memory_order_relaxed);
+    trace.dropped.store(0, std::memory_order_relaxed);
+    trace.generation = generation;
+}
+
+// On thread exit the events move into the registry and the chunks are freed.
+void retire_trace(ThreadTrace* trace)
+{
+    auto& reg = registry();
+    std::unique_lock lock(reg.mutex);
+
+    size_t size = trace->size.load(std::memory_order_relaxed);
+    size_t dropped = trace->dropped.load(std::memory_order_relaxed);
+    if (trace->generation == reg.generation.load(std::memory_order_relaxed) && (size > 0 || dropped > 0)) {
+        FinishedTrace finished { .tid = trace->tid, .dropped = dropped };
+        finished.events.reserve(size);
+        for_each_event(*trace, size, [&](const TraceEvent& event) { finished.events.emplace_back(event); });
+        reg.finished.emplace_back(std::move(finished));
+    }
+
+    std::erase_if(reg.threads, [&](const auto& owned) { return owned.get() == trace; });
+}
+
+struct ThreadTraceHolder
+{
+    ThreadTrace* trace = nullptr;
+
+    ~ThreadTraceHolder()
+    {
+        if (trace) {
+            retire_trace(trace);
+        }
+        retired = true;
+    }
+
+    // scopes ending in later thread_local destructors are not recorded
+    static thread_local bool retired;
+};
+
+thread_local bool ThreadTraceHolder::retired = false;
+
+ThreadTrace* thread_trace()
+{
+    if (ThreadTraceHolder::retired) {
+        return nullptr;
+    }
+
+    thread_local ThreadTraceHolder holder;
+    if (holder.trace) {
+        return holder.trace;
+    }
+
+    auto owned = std::make_unique<ThreadTrace>();
+    owned->tid = static_cast<uint16_t>(std::hash<std::thread::id> {}(std::this_thread::get_id()));
+    holder.trace = owned.get();
+
+    auto& reg = registry();
+    std::unique_lock lock(reg.mutex);
+    owned->generation = reg.generation.load(std::memory_order_relaxed);
+    reg.threads.emplace_back(std::move(owned));
+    return holder.trace;
+}
+
+void record(std::string_view name, char phase)
+{
+    auto* trace_ptr = thread_trace();
+    if (!trace_ptr) {
+        return;
+    }
+    auto& trace = *trace_ptr;
+
+    // only this thread changes its generation, the unlocked read is safe
+    if (size_t generation = registry().generation.load(std::memory_order_relaxed); trace.generation != generation) {
+        std::unique_lock lock(registry().mutex);
+        clear_trace(trace, generation);
+    }
+
+    size_t size = trace.size.load(std::memory_order_relaxed);
+    if (size >= registry().max_events.load(std::memory_order_relaxed)) {
+        trace.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (size > 0 && size % TraceChunk::kSize == 0) {
+        trace.tail->next = std::make_unique<TraceChunk>();
+        trace.tail = trace.tail->next.get();
+    }
+
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    trace.tail->events[size % TraceChunk::kSize] = { name, std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), phase };
+    trace.size.store(size + 1, std::memory_order_release);
+}
+}
+
+void Tracer::start(size_t max_events_per_thread)
+{
+    registry().max_events = max_events_per_thread;
+    enabled_ = true;
+}
+
+void Tracer::stop()
+{
+    enabled_ = false;
+}
+
+void Tracer::reset()
+{
+    auto& reg = registry();
+    std::unique_lock lock(reg.mutex);
+    reg.generation.fetch_add(1, std::memory_order_relaxed);
+    reg.finished.clear();
+    reg.finished.shrink_to_fit();
+}
+
+void Tracer::begin(std::string_view name)
+{
+    record(name, 'B');
+}
+
+void Tracer::end(std::string_view name)
+{
+    record(name, 'E');
+}
+
+bool Tracer::dump(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = ::getpid();
+#endif
+
+    std::ofstream ofs(path, std::ios::out | std::ios::trunc);
+    if (!ofs.is_open()) {
+        return false;
+    }
+
+    ofs << R"({"displayTimeUnit":"ms","traceEvents":[)";
+
+    std::string buffer;
+    bool first = true;
+    auto append_event = [&](const TraceEvent& event, uint16_t tid) {
+        buffer.append(first ? "{\"name\":\"" : ",{\"name\":\"");
+        first = false;
+        append_json_escaped(buffer, event.name);
+        std::format_to(
+            std::back_inserter(buffer),
+            R"(","ph":"{}","ts":{}.{:03},"pid":{},"tid":{}}})",
+            event.phase,
+            event.ts_ns / 1000,
+            event.ts_ns % 1000,
+            pid,
+            tid);
+    };
+
+    auto append_dropped = [&](size_t dropped, uint16_t tid) {
+        if (dropped == 0) {
+            return;
+        }
+        buffer.append(first ? "{" : ",{");
+        first = false;
+        std::format_to(
+            std::back_inserter(buffer),
+            R"("name":"dropped {} events","ph":"i","s":"t","ts":0,"pid":{},"tid":{}}})",
+            dropped,
+            pid,
+            tid);
+    };
+
+    auto& reg = registry();
+    std::unique_lock lock(reg.mutex);
+    const size_t generation = reg.generation.load(std::memory_order_relaxed);
+    for (const auto& trace : reg.threads) {
+        // recorded before the last reset(), the thread has not cleared them yet
+        if (trace->generation != generation) {
+            continue;
+        }
+        size_t size = trace->size.load(std::memory_order_acquire);
+        for_each_event(*trace, size, [&](const TraceEvent& event) { append_event(event, trace->tid); });
+        append_dropped(trace->dropped.load(std::memory_order_relaxed), trace->tid);
+
+        ofs << buffer;
+        buffer.clear();
+    }
+    for (const auto& trace : reg.finished) {
+        for (const auto& event : trace.events) {
+            append_event(event, trace.tid);
+        }
+        append_dropped(trace.dropped, trace.tid);
+
+        ofs << buffer;
+        buffer.clear();
+    }
+    lock.unlock();
+
+    ofs << "]}" << std::endl;
+    return ofs.good();
+}
+
+MAA_LOG_NS_END
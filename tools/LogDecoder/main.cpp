@@ -0,0 +1,224 @@
+// Renders maa.binlog (plain, or gzip compressed in builds with zlib) as the text maa.log would have contained.
+// usage: MaaLogDecoder <binlog> [output]
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef MAA_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "MaaUtils/LogBinary.h"
+#include "MaaUtils/Time.hpp"
+
+using namespace MAA_NS;
+using namespace MAA_LOG_NS;
+
+#ifdef MAA_WITH_ZLIB
+static bool read_file(const std::filesystem::path& file, std::string& data)
+{
+#ifdef _WIN32
+    gzFile gz = gzopen_w(file.c_str(), "rb");
+#else
+    gzFile gz = gzopen(file.c_str(), "rb");
+#endif
+    if (!gz) {
+        return false;
+    }
+
+    constexpr unsigned kChunkSize = 1024 * 1024;
+    int count = 0;
+    do {
+        size_t size = data.size();
+        data.resize(size + kChunkSize);
+        count = gzread(gz, data.data() + size, kChunkSize);
+        data.resize(size + (count > 0 ? count : 0));
+    } while (count > 0);
+
+    return gzclose(gz) == Z_OK && count == 0;
+}
+#else
+static bool read_file(const std::filesystem::path& file, std::string& data)
+{
+    std::ifstream ifs(file, std::ios::in | std::ios::binary);
+    if (!ifs.is_open()) {
+        return false;
+    }
+
+    std::ostringstream buffer;
+    buffer << ifs.rdbuf();
+    data = std::move(buffer).str();
+    return !ifs.bad();
+}
+#endif
+
+static std::string_view level_str(uint8_t lv)
+{
+    constexpr std::string_view kNames[] = { "NoLV", "FTL", "ERR", "WRN", "INF", "DBG", "TRC" };
+    return lv < std::size(kNames) ? kNames[lv] : kNames[0];
+}
+
+static std::string_view read_separator(binlog::Reader& reader)
+{
+    uint8_t index = reader.u8();
+    if (index == binlog::kSepCustom) {
+        return reader.bytes();
+    }
+    return index < std::size(binlog::kSeparators) ? binlog::kSeparators[index] : std::string_view();
+}
+
+class Decoder
+{
+public:
+    explicit Decoder(std::ostream& out)
+        : out_(out)
+    {
+    }
+
+    bool decode(std::string_view data)
+    {
+        if (!data.starts_with(binlog::kMagic)) {
+            std::cerr << "not a binary log" << std::endl;
+            return false;
+        }
+        binlog::Reader header(data.substr(binlog::kMagic.size()));
+        if (uint32_t version = header.u32(); version != binlog::kVersion) {
+            std::cerr << "unsupported version " << version << std::endl;
+            return false;
+        }
+
+        size_t pos = binlog::kMagic.size() + sizeof(uint32_t);
+        while (pos < data.size()) {
+            binlog::Reader head(data.substr(pos, binlog::kRecordHeaderSize));
+            auto kind = static_cast<binlog::record_kind>(head.u8());
+            uint32_t size = head.u32();
+            if (!head.ok() || data.size() - pos - binlog::kRecordHeaderSize < size) {
+                // the process died mid-write
+                std::cerr << "truncated record at offset " << pos << std::endl;
+                return false;
+            }
+
+            binlog::Reader body(data.substr(pos + binlog::kRecordHeaderSize, size));
+            switch (kind) {
+            case binlog::record_kind::site:
+                read_site(body);
+                break;
+            case binlog::record_kind::entry:
+                write_entry(body);
+                break;
+            default:
+                // unknown kinds are skipped
+                break;
+            }
+            if (!body.ok()) {
+                std::cerr << "malformed record at offset " << pos << std::endl;
+            }
+
+            pos += binlog::kRecordHeaderSize + size;
+        }
+        return true;
+    }
+
+private:
+    void read_site(binlog::Reader& body)
+    {
+        uint64_t id = body.varint();
+        uint64_t count = body.varint();
+
+        std::vector<std::string> props;
+        for (uint64_t i = 0; i < count && body.ok(); ++i) {
+            props.emplace_back(body.bytes());
+        }
+        sites_[id] = std::move(props);
+    }
+
+    void write_entry(binlog::Reader& body)
+    {
+        uint64_t site = body.varint();
+        auto millis = static_cast<int64_t>(body.varint());
+        uint64_t pid = body.varint();
+        uint64_t tid = body.varint();
+        uint8_t lv = body.u8();
+
+        line_ << "[" << format_local_millis(millis) << "][" << level_str(lv) << "][Px" << pid << "][Tx" << tid << "]";
+        if (auto it = sites_.find(site); it != sites_.end()) {
+            for (const auto& prop : it->second) {
+                line_ << "[" << prop << "]";
+            }
+        }
+        else {
+            line_ << "[site " << site << "]";
+        }
+        line_ << read_separator(body);
+
+        while (body.ok() && !body.empty()) {
+            switch (static_cast<binlog::arg_kind>(body.u8())) {
+            case binlog::arg_kind::text:
+                line_ << body.bytes();
+                break;
+            case binlog::arg_kind::sint:
+                line_ << body.zigzag();
+                break;
+            case binlog::arg_kind::uint:
+                line_ << body.varint();
+                break;
+            case binlog::arg_kind::real:
+                // default stream formatting, as LogStream prints doubles
+                line_ << body.f64();
+                break;
+            case binlog::arg_kind::boolean:
+                line_ << (body.u8() ? "true" : "false");
+                break;
+            default:
+                line_ << "<?>";
+                return flush_line();
+            }
+            line_ << read_separator(body);
+        }
+
+        flush_line();
+    }
+
+    void flush_line()
+    {
+        out_ << line_.view() << '\n';
+        line_.str({});
+    }
+
+private:
+    std::ostream& out_;
+    std::unordered_map<uint64_t, std::vector<std::string>> sites_;
+    std::ostringstream line_;
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <binlog> [output]" << std::endl;
+        return 1;
+    }
+
+    std::string data;
+    if (!read_file(argv[1], data)) {
+        std::cerr << "failed to read " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::ofstream ofs;
+    if (argc >= 3) {
+        ofs.open(argv[2], std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            std::cerr << "failed to open " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+
+    Decoder decoder(argc >= 3 ? ofs : std::cout);
+    return decoder.decode(data) ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+// Per-call cost of the log timestamp: the former gettimeofday + localtime + std::format
+// against the cached format_now() / format_now_view(), on one thread and on several at once.
+// usage: MaaTimeBench [calls per thread] [threads]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MaaUtils/Time.hpp"
+
+using namespace MAA_NS;
+
+// format_now() before the per-thread cache
+static std::string format_now_uncached()
+{
+    constexpr std::string_view kFormat = "{:0>4}-{:0>2}-{:0>2} {:0>2}:{:0>2}:{:0>2}.{:0>3}";
+
+#ifdef _WIN32
+    SYSTEMTIME sys {};
+    GetLocalTime(&sys);
+    return std::format(kFormat, sys.wYear, sys.wMonth, sys.wDay, sys.wHour, sys.wMinute, sys.wSecond, sys.wMilliseconds);
+#else
+    timeval tv = {};
+    gettimeofday(&tv, nullptr);
+    time_t nowtime = tv.tv_sec;
+    tm* tm_info = localtime(&nowtime);
+    return std::format(
+        kFormat,
+        tm_info->tm_year + 1900,
+        tm_info->tm_mon + 1,
+        tm_info->tm_mday,
+        tm_info->tm_hour,
+        tm_info->tm_min,
+        tm_info->tm_sec,
+        tv.tv_usec / 1000);
+#endif
+}
+
+// keeps the results alive so the calls are not optimized out
+static std::atomic_size_t sink = 0;
+
+template <typename func_t>
+static double ns_per_call(func_t func, size_t calls, size_t threads)
+{
+    auto run = [&]() {
+        size_t local = 0;
+        for (size_t i = 0; i < calls; ++i) {
+            local += func().size();
+        }
+        sink += local;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back(run);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    return static_cast<double>(elapsed.count()) / static_cast<double>(calls);
+}
+
+int main(int argc, char** argv)
+{
+    size_t calls = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+    size_t threads = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : std::max(2u, std::thread::hardware_concurrency());
+    if (calls == 0 || threads == 0) {
+        std::cerr << "usage: " << argv[0] << " [calls per thread] [threads]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "sample: " << format_now_uncached() << " / " << format_now() << std::endl;
+
+    for (size_t n : { size_t(1), threads }) {
+        std::cout << std::format("{} thread(s), ns per call (wall clock / calls per thread)", n) << std::endl;
+        std::cout << std::format("  uncached          {:8.1f}", ns_per_call(format_now_uncached, calls, n)) << std::endl;
+        std::cout << std::format("  format_now        {:8.1f}", ns_per_call(format_now, calls, n)) << std::endl;
+        std::cout << std::format("  format_now_view   {:8.1f}", ns_per_call(format_now_view, calls, n)) << std::endl;
+    }
+    return 0;
+}